@@ -0,0 +1,276 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "Benchmark.h"
+#include <fstream>
+
+
+const std::size_t Benchmark::NUM_WARMUP_FRAMES = 10;
+const std::size_t Benchmark::NUM_MEASURED_FRAMES = 60;
+
+
+std::vector<Benchmark::Scenario> Benchmark::makeScenarios()
+{
+    const std::size_t lightCounts[] = { 1, 4, 16, 64, 256 };
+    const std::size_t shapeCounts[] = { 10, 100, 1000, 10000, 50000 };
+    const std::size_t vertexCounts[] = { 4, 16, 100, 1000 };
+
+    std::vector<Scenario> scenarios;
+
+    for (int animated = 0; animated < 2; ++animated)
+    {
+        Scenario scenario;
+        scenario.numLights = 16;
+        scenario.numShapes = 1000;
+        scenario.numVertices = 4;
+        scenario.isAnimated = animated;
+        scenario.maxLightRadius = 400;
+
+        std::string suffix = animated ? "_animated" : "_static";
+
+        for (std::size_t i = 0; i < 5; ++i)
+        {
+            Scenario s = scenario;
+            s.numLights = lightCounts[i];
+            s.name = "lights_" + ofToString(s.numLights) + suffix;
+            scenarios.push_back(s);
+        }
+
+        for (std::size_t i = 0; i < 5; ++i)
+        {
+            Scenario s = scenario;
+            s.numShapes = shapeCounts[i];
+            s.name = "shapes_" + ofToString(s.numShapes) + suffix;
+            scenarios.push_back(s);
+        }
+
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            Scenario s = scenario;
+            s.numVertices = vertexCounts[i];
+            s.name = "vertices_" + ofToString(s.numVertices) + suffix;
+            scenarios.push_back(s);
+        }
+
+        // Many small lights, like particles or sparks.
+        Scenario sparks = scenario;
+        sparks.numLights = 1024;
+        sparks.maxLightRadius = 40;
+        sparks.name = "sparks_" + ofToString(sparks.numLights) + suffix;
+        scenarios.push_back(sparks);
+    }
+
+    return scenarios;
+}
+
+
+void Benchmark::setup(ofx::LightSystem2D& system,
+                      const Scenario& scenario,
+                      const ofRectangle& bounds)
+{
+    _scenario = scenario;
+    _lights.clear();
+    _shapes.clear();
+
+    // The same scene for every run of a scenario.
+    ofSeedRandom(scenario.numLights * 7919 + scenario.numShapes * 31 + scenario.numVertices);
+
+    for (std::size_t i = 0; i < scenario.numLights; ++i)
+    {
+        MovingLight moving;
+        moving.light = std::make_shared<ofx::Light2D>();
+        moving.center = ofVec3f(ofRandom(bounds.getMinX(), bounds.getMaxX()),
+                                ofRandom(bounds.getMinY(), bounds.getMaxY()));
+        moving.phase = ofRandom(TWO_PI);
+
+        moving.light->setPosition(moving.center);
+        moving.light->setRadius(ofRandom(scenario.maxLightRadius / 4, scenario.maxLightRadius));
+        moving.light->setColor(ofFloatColor(ofRandomuf(), ofRandomuf(), ofRandomuf(), 1));
+
+        if (i % 2 == 1)
+        {
+            moving.light->setAngle(ofRandom(TWO_PI));
+            moving.light->setViewAngle(ofRandom(PI / 4, PI / 2));
+        }
+
+        system.add(moving.light);
+        _lights.push_back(moving);
+    }
+
+    for (std::size_t i = 0; i < scenario.numShapes; ++i)
+    {
+        MovingShape moving;
+        moving.shape = std::make_shared<ofx::Shape2D>();
+        moving.phase = ofRandom(TWO_PI);
+
+        ofVec3f center(ofRandom(bounds.getMinX(), bounds.getMaxX()),
+                       ofRandom(bounds.getMinY(), bounds.getMaxY()));
+
+        float radius = ofRandom(5, 30);
+
+        for (std::size_t j = 0; j < scenario.numVertices; ++j)
+        {
+            float angle = TWO_PI * j / scenario.numVertices;
+            moving.outline.addVertex(center + ofVec3f(cos(angle), sin(angle)) * radius);
+        }
+
+        moving.outline.close();
+        moving.shape->setShape(moving.outline);
+
+        system.add(moving.shape);
+        _shapes.push_back(moving);
+    }
+}
+
+
+void Benchmark::animate(std::size_t frame)
+{
+    if (!_scenario.isAnimated)
+    {
+        return;
+    }
+
+    float time = frame / 60.0f;
+
+    for (std::size_t i = 0; i < _lights.size(); ++i)
+    {
+        MovingLight& moving = _lights[i];
+        float angle = time + moving.phase;
+
+        moving.light->setPosition(moving.center + ofVec3f(cos(angle), sin(angle)) * 50);
+        moving.light->setAngle(angle);
+    }
+
+    // One shape in ten moves.
+    for (std::size_t i = 0; i < _shapes.size(); i += 10)
+    {
+        MovingShape& moving = _shapes[i];
+        ofVec3f offset(20 * sin(time + moving.phase), 0);
+
+        ofPolyline outline = moving.outline;
+
+        for (std::size_t j = 0; j < outline.size(); ++j)
+        {
+            outline[j] += offset;
+        }
+
+        moving.shape->setShape(outline);
+    }
+}
+
+
+void Benchmark::begin()
+{
+    _result = Result();
+    _result.scenario = _scenario;
+}
+
+
+void Benchmark::add(const ofx::LightSystem2D::Stats& stats, uint64_t frameTime)
+{
+    ++_result.numFrames;
+    _result.numPairs = stats.numPairs;
+    _result.numPairsCulled = stats.numPairsCulled;
+    _result.numPairsSkipped = stats.numPairsSkipped;
+    _result.shadowMemory = std::max(_result.shadowMemory, stats.shadowMemory);
+    _result.maskTime += stats.maskTime;
+    _result.uploadTime += stats.uploadTime;
+    _result.lightTime += stats.lightTime;
+    _result.compositeTime += stats.compositeTime;
+    _result.frameTime += frameTime;
+    _result.bytesUploaded += stats.numBytesUploaded;
+}
+
+
+const Benchmark::Result& Benchmark::end()
+{
+    if (_result.numFrames > 0)
+    {
+        _result.maskTime /= _result.numFrames;
+        _result.uploadTime /= _result.numFrames;
+        _result.lightTime /= _result.numFrames;
+        _result.compositeTime /= _result.numFrames;
+        _result.frameTime /= _result.numFrames;
+        _result.bytesUploaded /= _result.numFrames;
+    }
+
+    return _result;
+}
+
+
+bool Benchmark::save(const std::string& path,
+                     const std::vector<Result>& results,
+                     bool isHeadless)
+{
+    std::ofstream file(path.c_str());
+
+    if (!file)
+    {
+        ofLogError("Benchmark::save") << "Unable to write " << path;
+        return false;
+    }
+
+    file << "{\n";
+    file << "  \"headless\": " << (isHeadless ? "true" : "false") << ",\n";
+    file << "  \"warmupFrames\": " << NUM_WARMUP_FRAMES << ",\n";
+    file << "  \"measuredFrames\": " << NUM_MEASURED_FRAMES << ",\n";
+    file << "  \"results\": [\n";
+
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& result = results[i];
+        const Scenario& scenario = result.scenario;
+
+        std::size_t numVisiblePairs = result.numPairs - result.numPairsCulled - result.numPairsSkipped;
+
+        double memoryPerPair = numVisiblePairs > 0 ? double(result.shadowMemory) / numVisiblePairs : 0;
+
+        file << "    {\n";
+        file << "      \"name\": \"" << scenario.name << "\",\n";
+        file << "      \"lights\": " << scenario.numLights << ",\n";
+        file << "      \"shapes\": " << scenario.numShapes << ",\n";
+        file << "      \"vertices\": " << scenario.numVertices << ",\n";
+        file << "      \"animated\": " << (scenario.isAnimated ? "true" : "false") << ",\n";
+        file << "      \"maxLightRadius\": " << scenario.maxLightRadius << ",\n";
+        file << "      \"pairs\": " << result.numPairs << ",\n";
+        file << "      \"pairsCulled\": " << result.numPairsCulled << ",\n";
+        file << "      \"pairsSkipped\": " << result.numPairsSkipped << ",\n";
+        file << "      \"shadowMemoryBytes\": " << result.shadowMemory << ",\n";
+        file << "      \"memoryPerPairBytes\": " << memoryPerPair << ",\n";
+        file << "      \"maskTimeUs\": " << result.maskTime << ",\n";
+        file << "      \"uploadTimeUs\": " << result.uploadTime << ",\n";
+        file << "      \"lightTimeUs\": " << result.lightTime << ",\n";
+        file << "      \"compositeTimeUs\": " << result.compositeTime << ",\n";
+        file << "      \"frameTimeUs\": " << result.frameTime << ",\n";
+        file << "      \"bytesUploaded\": " << result.bytesUploaded << "\n";
+        file << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    file << "  ]\n";
+    file << "}\n";
+
+    return true;
+}
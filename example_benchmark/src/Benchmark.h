@@ -0,0 +1,114 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include "ofMain.h"
+#include "LightSystem2D.h"
+
+
+// Builds the benchmark scenes, drives their animation and collects the
+// per-phase timings reported by LightSystem2D::getStats().
+class Benchmark
+{
+public:
+    struct Scenario
+    {
+        std::string name;
+        std::size_t numLights;
+        std::size_t numShapes;
+        std::size_t numVertices;
+        bool isAnimated;
+
+        // Lights get a random radius from a quarter of this up to it.
+        float maxLightRadius;
+    };
+
+    struct Result
+    {
+        Scenario scenario;
+        std::size_t numFrames;
+        std::size_t numPairs;
+        std::size_t numPairsCulled;
+        std::size_t numPairsSkipped;
+        std::size_t shadowMemory;
+
+        // Mean per-frame values, in microseconds.
+        double maskTime;
+        double uploadTime;
+        double lightTime;
+        double compositeTime;
+        double frameTime;
+
+        // Mean shadow geometry bytes uploaded per frame.
+        double bytesUploaded;
+    };
+
+    // Sweep lights, shapes and polygon vertex counts one axis at a time,
+    // each with a static and an animated scene.
+    static std::vector<Scenario> makeScenarios();
+
+    void setup(ofx::LightSystem2D& system,
+               const Scenario& scenario,
+               const ofRectangle& bounds);
+
+    void animate(std::size_t frame);
+
+    void begin();
+    void add(const ofx::LightSystem2D::Stats& stats, uint64_t frameTime);
+    const Result& end();
+
+    static bool save(const std::string& path,
+                     const std::vector<Result>& results,
+                     bool isHeadless);
+
+    static const std::size_t NUM_WARMUP_FRAMES;
+    static const std::size_t NUM_MEASURED_FRAMES;
+
+private:
+    struct MovingLight
+    {
+        ofx::Light2D::SharedPtr light;
+        ofVec3f center;
+        float phase;
+    };
+
+    struct MovingShape
+    {
+        ofx::Shape2D::SharedPtr shape;
+        ofPolyline outline;
+        float phase;
+    };
+
+    Scenario _scenario;
+
+    std::vector<MovingLight> _lights;
+    std::vector<MovingShape> _shapes;
+
+    Result _result;
+
+};
@@ -0,0 +1,133 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "ofApp.h"
+
+
+// Usage: example_benchmark [--headless] [--full-vertices] [--visibility]
+//                          [--tiled] [--polar] [--output results.json]
+//
+// With --headless no window or GL context is created, and only the
+// geometry phases (culling, mask generation and batching) are measured.
+// --full-vertices uploads shadow masks in the original position and color
+// layout, to compare upload bandwidth with the compact default.
+// --visibility draws each light into its visibility polygon instead of
+// masking it with per-shape shadows.
+// --tiled adds all lights to the scene in one tiled pass, with polar
+// shadow maps.  --polar finds those maps on the GPU instead, and builds no
+// shadow geometry at all.
+int runHeadless(const std::string& outputPath,
+                bool isCompactVerticesEnabled,
+                ofx::LightSystem2D::CompositeMode compositeMode,
+                ofx::LightSystem2D::ShadowMode shadowMode)
+{
+    std::vector<Benchmark::Scenario> scenarios = Benchmark::makeScenarios();
+    std::vector<Benchmark::Result> results;
+
+    Benchmark benchmark;
+
+    ofEventArgs args;
+
+    for (std::size_t i = 0; i < scenarios.size(); ++i)
+    {
+        ofx::LightSystem2D lightSystem;
+        lightSystem.setCompactVerticesEnabled(isCompactVerticesEnabled);
+        lightSystem.setCompositeMode(compositeMode);
+        lightSystem.setShadowMode(shadowMode);
+
+        benchmark.setup(lightSystem, scenarios[i], ofRectangle(0, 0, 1920, 1080));
+        benchmark.begin();
+
+        for (std::size_t frame = 0; frame < Benchmark::NUM_WARMUP_FRAMES + Benchmark::NUM_MEASURED_FRAMES; ++frame)
+        {
+            benchmark.animate(frame);
+
+            uint64_t startTime = ofGetElapsedTimeMicros();
+            lightSystem.update(args);
+            uint64_t frameTime = ofGetElapsedTimeMicros() - startTime;
+
+            if (frame >= Benchmark::NUM_WARMUP_FRAMES)
+            {
+                benchmark.add(lightSystem.getStats(), frameTime);
+            }
+        }
+
+        results.push_back(benchmark.end());
+
+        std::cout << results.back().scenario.name << ": "
+                  << results.back().maskTime << " us mask generation" << std::endl;
+    }
+
+    return Benchmark::save(outputPath, results, true) ? 0 : 1;
+}
+
+
+int main(int argc, char* argv[])
+{
+    bool isHeadless = false;
+    bool isCompactVerticesEnabled = true;
+    ofx::LightSystem2D::CompositeMode compositeMode = ofx::LightSystem2D::COMPOSITE_FBO;
+    ofx::LightSystem2D::ShadowMode shadowMode = ofx::LightSystem2D::SHADOW_MASKS;
+    std::string outputPath = "benchmark.json";
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+
+        if (argument == "--headless")
+        {
+            isHeadless = true;
+        }
+        else if (argument == "--full-vertices")
+        {
+            isCompactVerticesEnabled = false;
+        }
+        else if (argument == "--visibility")
+        {
+            shadowMode = ofx::LightSystem2D::SHADOW_VISIBILITY;
+        }
+        else if (argument == "--polar")
+        {
+            shadowMode = ofx::LightSystem2D::SHADOW_POLAR;
+        }
+        else if (argument == "--tiled")
+        {
+            compositeMode = ofx::LightSystem2D::COMPOSITE_TILED;
+        }
+        else if (argument == "--output" && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+        }
+    }
+
+    if (isHeadless)
+    {
+        return runHeadless(outputPath, isCompactVerticesEnabled, compositeMode, shadowMode);
+    }
+
+    ofSetupOpenGL(1920, 1080, OF_WINDOW);
+    ofRunApp(new ofApp(outputPath, isCompactVerticesEnabled, compositeMode, shadowMode));
+}
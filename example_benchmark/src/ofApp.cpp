@@ -0,0 +1,117 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "ofApp.h"
+
+
+ofApp::ofApp(const std::string& outputPath_,
+             bool isCompactVerticesEnabled_,
+             ofx::LightSystem2D::CompositeMode compositeMode_,
+             ofx::LightSystem2D::ShadowMode shadowMode_):
+    outputPath(outputPath_),
+    isCompactVerticesEnabled(isCompactVerticesEnabled_),
+    compositeMode(compositeMode_),
+    shadowMode(shadowMode_),
+    scenarioIndex(0),
+    frame(0),
+    lastFrameTime(0)
+{
+}
+
+
+void ofApp::setup()
+{
+    ofSetVerticalSync(false);
+    ofSetFrameRate(0);
+
+    scenarios = Benchmark::makeScenarios();
+
+    startScenario();
+}
+
+
+void ofApp::update()
+{
+    // The light system draws after the app, so its stats describe the
+    // previous frame.
+    uint64_t now = ofGetElapsedTimeMicros();
+
+    if (frame > Benchmark::NUM_WARMUP_FRAMES)
+    {
+        benchmark.add(lightSystem->getStats(), now - lastFrameTime);
+    }
+
+    lastFrameTime = now;
+
+    if (frame == Benchmark::NUM_WARMUP_FRAMES + Benchmark::NUM_MEASURED_FRAMES)
+    {
+        results.push_back(benchmark.end());
+
+        ofLogNotice("ofApp::update") << results.back().scenario.name << ": "
+                                     << results.back().frameTime << " us / frame";
+
+        ++scenarioIndex;
+
+        if (scenarioIndex == scenarios.size())
+        {
+            Benchmark::save(ofToDataPath(outputPath), results, false);
+            ofExit();
+            return;
+        }
+
+        startScenario();
+    }
+
+    benchmark.animate(frame);
+
+    ++frame;
+}
+
+
+void ofApp::draw()
+{
+    ofBackground(0);
+}
+
+
+void ofApp::startScenario()
+{
+    // A fresh system per scenario, so no cached geometry carries over.
+    lightSystem.reset(new ofx::LightSystem2D());
+    lightSystem->setCompactVerticesEnabled(isCompactVerticesEnabled);
+    lightSystem->setCompositeMode(compositeMode);
+    lightSystem->setShadowMode(shadowMode);
+
+    ofEventArgs args;
+    lightSystem->setup(args);
+
+    benchmark.setup(*lightSystem,
+                    scenarios[scenarioIndex],
+                    ofRectangle(0, 0, ofGetWidth(), ofGetHeight()));
+    benchmark.begin();
+
+    frame = 0;
+}
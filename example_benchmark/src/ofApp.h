@@ -0,0 +1,65 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include "ofMain.h"
+#include "Benchmark.h"
+
+
+// Runs every benchmark scenario through the full GPU pipeline, one after
+// another, then writes the results and exits.
+class ofApp: public ofBaseApp
+{
+public:
+    ofApp(const std::string& outputPath,
+          bool isCompactVerticesEnabled,
+          ofx::LightSystem2D::CompositeMode compositeMode,
+          ofx::LightSystem2D::ShadowMode shadowMode);
+
+    void setup();
+    void update();
+    void draw();
+
+    void startScenario();
+
+    std::string outputPath;
+    bool isCompactVerticesEnabled;
+    ofx::LightSystem2D::CompositeMode compositeMode;
+    ofx::LightSystem2D::ShadowMode shadowMode;
+
+    std::vector<Benchmark::Scenario> scenarios;
+    std::vector<Benchmark::Result> results;
+
+    std::size_t scenarioIndex;
+    std::size_t frame;
+    uint64_t lastFrameTime;
+
+    Benchmark benchmark;
+
+    std::unique_ptr<ofx::LightSystem2D> lightSystem;
+};
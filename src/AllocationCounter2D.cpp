@@ -0,0 +1,112 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "AllocationCounter2D.h"
+
+
+#if defined(OFX_LIGHT2D_COUNT_ALLOCATIONS)
+
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+namespace {
+
+
+std::atomic<uint64_t> allocationCount(0);
+
+
+void* allocate(std::size_t size)
+{
+    ++allocationCount;
+
+    void* pointer = std::malloc(size == 0 ? 1 : size);
+
+    if (!pointer)
+    {
+        throw std::bad_alloc();
+    }
+
+    return pointer;
+}
+
+
+}
+
+
+void* operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+
+void* operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+
+void operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+
+#endif
+
+
+namespace ofx {
+
+
+bool AllocationCounter2D::isEnabled()
+{
+#if defined(OFX_LIGHT2D_COUNT_ALLOCATIONS)
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+uint64_t AllocationCounter2D::getCount()
+{
+#if defined(OFX_LIGHT2D_COUNT_ALLOCATIONS)
+    return allocationCount;
+#else
+    return 0;
+#endif
+}
+
+
+} // namespace ofx
@@ -0,0 +1,53 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include <cstdint>
+
+
+namespace ofx {
+
+
+// Counts heap allocations for checking that steady-state frames allocate
+// nothing.
+//
+// Counting replaces the global operator new, so it is only compiled in
+// when OFX_LIGHT2D_COUNT_ALLOCATIONS is defined, e.g. in a debug build's
+// compiler flags.  Otherwise the count is always zero.
+class AllocationCounter2D
+{
+public:
+    static bool isEnabled();
+
+    // The number of allocations made by all threads so far.
+    static uint64_t getCount();
+
+};
+
+
+} // namespace ofx
@@ -25,6 +25,7 @@
 
 #include "Light2D.h"
 #include "ofGraphics.h"
+#include "ofMath.h"
 #include "ofAppRunner.h"
 #include "ofEvents.h"
 
@@ -37,6 +38,8 @@ namespace ofx {
 
 const float Light2D::DEFAULT_RADIUS = 500;
 const float Light2D::DEFAULT_RANGE = 500;
+const float Light2D::MAX_CHORD_ERROR = 0.5;
+const std::size_t Light2D::MAX_SEGMENTS = 1024;
 const std::string Light2D::DEFAULT_LIGHT_SHADER_FRAGMENT_SRC = STRINGIFY(
 
 uniform vec3 lightPos;
@@ -44,13 +47,14 @@ uniform vec4 lightColor;
 uniform float radius;
 uniform float bleed;
 uniform float linearizeFactor;
+uniform float scale;
 
 void main()
 {
     // We have our camera set up such that the fragment is equivalent to
-    // the pixel at the x / y position.
+    // the pixel at the x / y position, divided by the target's scale.
     // Get the distance from this pixel to the light's position.
-    float dist = length(lightPos - gl_FragCoord.xyz);
+    float dist = length(lightPos - vec3(gl_FragCoord.xy / scale, gl_FragCoord.z));
     
     float attenuation = (radius - dist) * (bleed / pow(dist, 2.0) + linearizeFactor / radius);
     
@@ -75,19 +79,12 @@ Light2D::Light2D():
     _color(1.0, 1.0, 1.0, 1.0),
     _linearizeFactor(1),
     _bleed(0),
+    _sourceRadius(0),
+    _castsShadows(true),
+    _isStatic(false),
+    _version(0),
     _isMeshDirty(true)
 {
-    if (!DEFAULT_LIGHT_SHADER.isLoaded())
-    {
-        DEFAULT_LIGHT_SHADER.setupShaderFromSource(GL_FRAGMENT_SHADER,
-                                                   DEFAULT_LIGHT_SHADER_FRAGMENT_SRC);
-        if (ofIsGLProgrammableRenderer())
-        {
-            DEFAULT_LIGHT_SHADER.bindDefaults();
-        }
-
-        DEFAULT_LIGHT_SHADER.linkProgram();
-    }
 }
 
 
@@ -107,6 +104,40 @@ void Light2D::update()
 
 void Light2D::draw()
 {
+    draw(1);
+}
+
+
+void Light2D::draw(float scale)
+{
+    begin(scale);
+
+    ofPushMatrix();
+    ofTranslate(_position);
+    ofRotateZ(ofRadToDeg(_angle - _viewAngle / 2.0));
+    _mesh.draw();
+    ofPopMatrix();
+
+    end();
+}
+
+
+void Light2D::begin(float scale)
+{
+    // The shader is set up on first use, so that lights can be created and
+    // evaluated without a GL context.
+    if (!DEFAULT_LIGHT_SHADER.isLoaded())
+    {
+        DEFAULT_LIGHT_SHADER.setupShaderFromSource(GL_FRAGMENT_SHADER,
+                                                   DEFAULT_LIGHT_SHADER_FRAGMENT_SRC);
+        if (ofIsGLProgrammableRenderer())
+        {
+            DEFAULT_LIGHT_SHADER.bindDefaults();
+        }
+
+        DEFAULT_LIGHT_SHADER.linkProgram();
+    }
+
     DEFAULT_LIGHT_SHADER.begin();
 
     DEFAULT_LIGHT_SHADER.setUniform4f("lightColor", _color.r, _color.g, _color.b, _color.a);
@@ -114,13 +145,12 @@ void Light2D::draw()
     DEFAULT_LIGHT_SHADER.setUniform1f("radius", _radius);
     DEFAULT_LIGHT_SHADER.setUniform1f("bleed", _bleed);
     DEFAULT_LIGHT_SHADER.setUniform1f("linearizeFactor", _linearizeFactor);
+    DEFAULT_LIGHT_SHADER.setUniform1f("scale", scale);
+}
 
-    ofPushMatrix();
-    ofTranslate(_position);
-    ofRotateZ(ofRadToDeg(_angle - _viewAngle / 2.0));
-    _mesh.draw();
-    ofPopMatrix();
 
+void Light2D::end()
+{
     DEFAULT_LIGHT_SHADER.end();
 }
 
@@ -129,6 +159,7 @@ void Light2D::setPosition(const ofVec3f& position)
 {
     _position = position;
     _isMeshDirty = true;
+    ++_version;
 }
 
 
@@ -142,6 +173,7 @@ void Light2D::setAngle(float angle)
 {
     _angle = angle;
     _isMeshDirty = true;
+    ++_version;
 }
 
 
@@ -154,6 +186,7 @@ void Light2D::setViewAngle(float viewAngle)
 {
     _viewAngle = viewAngle;
     _isMeshDirty = true;
+    ++_version;
 }
 
 
@@ -172,13 +205,15 @@ float Light2D::getRadius() const
 void Light2D::setRadius(float radius)
 {
     _radius = radius;
+    _isMeshDirty = true;
+    ++_version;
 }
 
 
 void Light2D::setColor(const ofFloatColor& color)
 {
+    // The color is a shader uniform, so the mesh is unchanged.
     _color = color;
-    _isMeshDirty = true;
 }
 
 
@@ -211,43 +246,174 @@ void Light2D::setLinearizeFactor(float linearizeFactor)
 }
 
 
-void Light2D::createMesh() const
+void Light2D::setSourceRadius(float sourceRadius)
 {
-    _mesh.clear();
-    _mesh.setMode(OF_PRIMITIVE_TRIANGLE_FAN);
+    _sourceRadius = std::max(sourceRadius, 0.0f);
+    ++_version;
+}
+
+
+float Light2D::getSourceRadius() const
+{
+    return _sourceRadius;
+}
+
+
+void Light2D::setCastsShadows(bool castsShadows)
+{
+    _castsShadows = castsShadows;
+}
+
+
+bool Light2D::getCastsShadows() const
+{
+    return _castsShadows;
+}
+
+
+void Light2D::setStatic(bool isStatic)
+{
+    _isStatic = isStatic;
+    ++_version;
+}
+
 
-    ofVec3f position(0, 0, 0);
+bool Light2D::isStatic() const
+{
+    return _isStatic;
+}
 
-    ofFloatColor color(_color);
 
-    _mesh.addVertex(position);
-    _mesh.addColor(color);
+ofRectangle Light2D::getBoundingBox() const
+{
+    ofRectangle box;
+
+    if (_viewAngle >= TWO_PI)
+    {
+        box.setFromCenter(_position.x, _position.y, 2 * _radius, 2 * _radius);
+        return box;
+    }
 
-    color = ofFloatColor(0, 0, 0, 0);
+    float startAngle = _angle - _viewAngle / 2.0;
+    float endAngle = startAngle + _viewAngle;
 
-    float fanIncrement = TWO_PI / 32;
+    box.set(_position.x, _position.y, 0, 0);
+    box.growToInclude(_position + ofVec3f(cos(startAngle), sin(startAngle)) * _radius);
+    box.growToInclude(_position + ofVec3f(cos(endAngle), sin(endAngle)) * _radius);
 
-    for (float angle = 0.0; angle < _viewAngle; angle += fanIncrement)
+    // Include any axis-aligned extremes of the circle that lie in the wedge.
+    for (int i = 0; i < 4; ++i)
     {
-        if (angle > _viewAngle)
+        float extremeAngle = i * HALF_PI;
+
+        if (ofWrapRadians(extremeAngle - startAngle, 0, TWO_PI) < _viewAngle)
         {
-            angle = _viewAngle;
+            box.growToInclude(_position + ofVec3f(cos(extremeAngle), sin(extremeAngle)) * _radius);
         }
+    }
+
+    return box;
+}
 
-        position.x = cos(angle);
-        position.y = sin(angle);
 
-        position *= (_radius * _radius);
+float Light2D::getAttenuation(const ofVec2f& point) const
+{
+    float dx = point.x - _position.x;
+    float dy = point.y - _position.y;
+
+    if (_viewAngle < TWO_PI)
+    {
+        float startAngle = _angle - _viewAngle / 2.0;
 
-        _mesh.addVertex(position);
-        _mesh.addColor(color);
+        if (ofWrapRadians(atan2(dy, dx) - startAngle, 0, TWO_PI) > _viewAngle)
+        {
+            return 0;
+        }
+    }
+
+    float distanceSquared = dx * dx + dy * dy;
+    float distance = sqrt(distanceSquared);
+
+    // The same falloff as DEFAULT_LIGHT_SHADER_FRAGMENT_SRC.
+    float falloff = _linearizeFactor / _radius;
+
+    if (_bleed != 0)
+    {
+        falloff += _bleed / distanceSquared;
     }
 
-    position.x = _radius;
-    position.y = 0;
+    return ofClamp((_radius - distance) * falloff, 0, 1);
+}
+
 
-    _mesh.addVertex(position);
-    _mesh.addColor(color);
+float Light2D::getPenumbra(const ofVec2f& texCoord)
+{
+    // s / (1 - t) is the fraction of the way across the fin, along the
+    // line from the silhouette point.
+    float penumbra = ofClamp(texCoord.x / std::max(1 - texCoord.y, 0.0001f), 0, 1);
+
+    return penumbra * penumbra * (3 - 2 * penumbra);
+}
+
+
+const ofMesh& Light2D::getMesh() const
+{
+    if (_isMeshDirty)
+    {
+        createMesh();
+    }
+
+    return _mesh;
+}
+
+
+std::size_t Light2D::getVersion() const
+{
+    return _version;
+}
+
+
+std::size_t Light2D::getNumSegments(float radius, float angle)
+{
+    if (radius <= MAX_CHORD_ERROR)
+    {
+        return std::max(1.0, std::ceil(angle / HALF_PI));
+    }
+
+    // A chord through a circle of radius r / cos(step / 2) touches the
+    // circle, and its ends lie r / cos(step / 2) - r outside it.
+    float step = 2 * acos(radius / (radius + MAX_CHORD_ERROR));
+
+    std::size_t numSegments = std::ceil(angle / step);
+
+    return std::min(std::max(numSegments, std::size_t(1)), MAX_SEGMENTS);
+}
+
+
+void Light2D::createMesh() const
+{
+    // Positions only; the shader takes the color from the lightColor
+    // uniform.
+    _mesh.clear();
+    _mesh.setMode(OF_PRIMITIVE_TRIANGLE_FAN);
+
+    float viewAngle = std::min(_viewAngle, (float)TWO_PI);
+
+    std::size_t numSegments = getNumSegments(_radius, viewAngle);
+
+    float step = viewAngle / numSegments;
+
+    // Push the rim out so that the fan's chords enclose the circle.
+    float reach = _radius / cos(step / 2);
+
+    _mesh.addVertex(ofVec3f(0, 0, 0));
+
+    for (std::size_t i = 0; i <= numSegments; ++i)
+    {
+        float angle = i * step;
+
+        _mesh.addVertex(ofVec3f(cos(angle), sin(angle), 0) * reach);
+    }
 
     _isMeshDirty = false;
 }
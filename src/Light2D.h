@@ -30,6 +30,7 @@
 #include "ofColor.h"
 #include "ofMesh.h"
 #include "ofShader.h"
+#include "ofRectangle.h"
 
 
 namespace ofx {
@@ -47,6 +48,17 @@ public:
     virtual void update();
     virtual void draw();
 
+    // Draw into a target whose pixels are scale times the world units,
+    // such as a reduced-resolution lightmap.  LightSystem2D calls draw()
+    // unless the lightmap is reduced, so a subclass that draws itself must
+    // override this too before it is used with a reduced lightmap.
+    virtual void draw(float scale);
+
+    // Bind the light's shader so that geometry drawn in world coordinates
+    // until end() is lit, e.g. a visibility polygon instead of the fan.
+    virtual void begin(float scale);
+    virtual void end();
+
     void setPosition(const ofVec3f& position);
     const ofVec3f& getPosition() const;
 
@@ -68,6 +80,49 @@ public:
     float getLinearizeFactor() const;
     void setLinearizeFactor(float linearizeFactor);
 
+    // The radius of the light's source.  Zero, the default, is a point
+    // light with hard shadows; a larger source casts penumbra fins.
+    void setSourceRadius(float sourceRadius);
+    float getSourceRadius() const;
+
+    // Lights that cast no shadows skip shadow geometry entirely and can be
+    // drawn together in one instanced call.
+    void setCastsShadows(bool castsShadows);
+    bool getCastsShadows() const;
+
+    // Static lights are baked into a cached layer together with the shadows
+    // of static shapes, and only drawn again when they or those shapes
+    // change, or while a dynamic shape is in their reach.
+    void setStatic(bool isStatic);
+    bool isStatic() const;
+
+    ofRectangle getBoundingBox() const;
+
+    // The clamped attenuation of the light at a point, zero outside the
+    // view-angle wedge.  Matches DEFAULT_LIGHT_SHADER_FRAGMENT_SRC.
+    float getAttenuation(const ofVec2f& point) const;
+
+    // The fraction of the light that passes a point of a shadow mask, from
+    // the mask's interpolated texture coordinate.  Umbras have (0, 0) and
+    // penumbra fins run from (0, 0) on the umbra edge to (1, 0) on the lit
+    // edge, with (0, 1) at the silhouette point.  Matches the penumbra
+    // shader of LightSystem2D.
+    static float getPenumbra(const ofVec2f& texCoord);
+
+    // The light's fan in local coordinates.  draw() places it at the
+    // position, rotated by getAngle() - getViewAngle() / 2.
+    const ofMesh& getMesh() const;
+
+    std::size_t getVersion() const;
+
+    // The number of segments for an arc of the angle, so that chords pushed
+    // out to enclose a circle of the radius stray from it by at most
+    // MAX_CHORD_ERROR pixels.
+    static std::size_t getNumSegments(float radius, float angle);
+
+    static const float MAX_CHORD_ERROR;
+    static const std::size_t MAX_SEGMENTS;
+
     static const float DEFAULT_RADIUS;
     static const float DEFAULT_RANGE;
     static const std::string DEFAULT_LIGHT_SHADER_FRAGMENT_SRC;
@@ -84,6 +139,11 @@ protected:
     ofFloatColor _color;
     float _bleed;
     float _linearizeFactor;
+    float _sourceRadius;
+    bool _castsShadows;
+    bool _isStatic;
+
+    std::size_t _version;
 
     void createMesh() const;
     mutable bool _isMeshDirty;
@@ -0,0 +1,246 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "LightBatch2D.h"
+#include <algorithm>
+#include "ofAppRunner.h"
+#include "ofGraphics.h"
+
+
+#define STRINGIFY(x) #x
+
+
+namespace ofx {
+
+
+const std::string LightBatch2D::DEFAULT_VERTEX_SHADER_SRC = "#version 150\n" STRINGIFY(
+
+uniform mat4 modelViewProjectionMatrix;
+uniform float numSegments;
+
+// x is the fraction of the view angle, y is 0 at the center, 1 on the rim.
+in vec4 position;
+
+in vec4 lightPosition;
+in vec4 lightColor;
+in vec4 lightParameters;
+
+out vec2 offset;
+flat out vec4 color;
+flat out vec3 parameters;
+
+void main()
+{
+    float segmentAngle = lightParameters.y / numSegments;
+
+    // Push the rim out so that the fan's chords enclose the circle.
+    float reach = position.y * lightPosition.z / cos(0.5 * segmentAngle);
+    float angle = lightParameters.x + position.x * lightParameters.y;
+
+    offset = vec2(cos(angle), sin(angle)) * reach;
+    color = lightColor;
+    parameters = vec3(lightPosition.z, lightParameters.zw);
+
+    gl_Position = modelViewProjectionMatrix * vec4(lightPosition.xy + offset, 0.0, 1.0);
+}
+
+);
+
+
+const std::string LightBatch2D::DEFAULT_FRAGMENT_SHADER_SRC = "#version 150\n" STRINGIFY(
+
+in vec2 offset;
+flat in vec4 color;
+flat in vec3 parameters;
+
+out vec4 fragColor;
+
+void main()
+{
+    float radius = parameters.x;
+    float dist = length(offset);
+
+    // The same falloff as Light2D::DEFAULT_LIGHT_SHADER_FRAGMENT_SRC.
+    float attenuation = (radius - dist) * (parameters.y / pow(dist, 2.0) + parameters.z / radius);
+
+    attenuation = clamp(attenuation, 0.0, 1.0);
+
+    fragColor = color * attenuation;
+}
+
+);
+
+
+LightBatch2D::LightBatch2D():
+    _maxRadius(0),
+    _isSetup(false),
+    _numSegments(0)
+{
+}
+
+
+LightBatch2D::~LightBatch2D()
+{
+}
+
+
+void LightBatch2D::clear()
+{
+    _positions.clear();
+    _colors.clear();
+    _parameters.clear();
+
+    _maxRadius = 0;
+}
+
+
+void LightBatch2D::add(const Light2D& light)
+{
+    const ofVec3f& position = light.getPosition();
+    ofFloatColor color = light.getColor();
+
+    _positions.push_back(position.x);
+    _positions.push_back(position.y);
+    _positions.push_back(light.getRadius());
+    _positions.push_back(0);
+
+    _colors.push_back(color.r);
+    _colors.push_back(color.g);
+    _colors.push_back(color.b);
+    _colors.push_back(color.a);
+
+    _parameters.push_back(light.getAngle() - light.getViewAngle() / 2.0);
+    _parameters.push_back(light.getViewAngle());
+    _parameters.push_back(light.getBleed());
+    _parameters.push_back(light.getLinearizeFactor());
+
+    _maxRadius = std::max(_maxRadius, light.getRadius());
+}
+
+
+std::size_t LightBatch2D::size() const
+{
+    return _positions.size() / 4;
+}
+
+
+bool LightBatch2D::empty() const
+{
+    return _positions.empty();
+}
+
+
+void LightBatch2D::draw()
+{
+    if (empty())
+    {
+        return;
+    }
+
+    if (!_isSetup)
+    {
+        setup();
+    }
+
+    // The fan is fine enough for the largest light, and only rebuilt when
+    // that needs a different number of segments.
+    std::size_t numSegments = Light2D::getNumSegments(_maxRadius, TWO_PI);
+
+    if (numSegments != _numSegments)
+    {
+        setupFan(numSegments);
+    }
+
+    int numInstances = size();
+
+    // The same lights are drawn for every damaged region, and often for
+    // many frames, so they are only uploaded when they change.
+    if (_positions != _uploadedPositions ||
+        _colors != _uploadedColors ||
+        _parameters != _uploadedParameters)
+    {
+        _vbo.setAttributeData(POSITION_ATTRIBUTE, &_positions[0], 4, numInstances, GL_STREAM_DRAW);
+        _vbo.setAttributeData(COLOR_ATTRIBUTE, &_colors[0], 4, numInstances, GL_STREAM_DRAW);
+        _vbo.setAttributeData(PARAMETERS_ATTRIBUTE, &_parameters[0], 4, numInstances, GL_STREAM_DRAW);
+
+        _vbo.setAttributeDivisor(POSITION_ATTRIBUTE, 1);
+        _vbo.setAttributeDivisor(COLOR_ATTRIBUTE, 1);
+        _vbo.setAttributeDivisor(PARAMETERS_ATTRIBUTE, 1);
+
+        _uploadedPositions = _positions;
+        _uploadedColors = _colors;
+        _uploadedParameters = _parameters;
+    }
+
+    _shader.begin();
+    _shader.setUniform1f("numSegments", _numSegments);
+    _vbo.drawInstanced(GL_TRIANGLE_FAN, 0, _numSegments + 2, numInstances);
+    _shader.end();
+}
+
+
+bool LightBatch2D::isSupported()
+{
+    return ofIsGLProgrammableRenderer();
+}
+
+
+void LightBatch2D::setup()
+{
+    _shader.setupShaderFromSource(GL_VERTEX_SHADER, DEFAULT_VERTEX_SHADER_SRC);
+    _shader.setupShaderFromSource(GL_FRAGMENT_SHADER, DEFAULT_FRAGMENT_SHADER_SRC);
+    _shader.bindDefaults();
+    _shader.bindAttribute(POSITION_ATTRIBUTE, "lightPosition");
+    _shader.bindAttribute(COLOR_ATTRIBUTE, "lightColor");
+    _shader.bindAttribute(PARAMETERS_ATTRIBUTE, "lightParameters");
+    _shader.linkProgram();
+
+    _isSetup = true;
+}
+
+
+void LightBatch2D::setupFan(std::size_t numSegments)
+{
+    // The unit fan: the center, then the rim from the start to the end of
+    // the view angle.
+    std::vector<float> fan;
+
+    fan.push_back(0);
+    fan.push_back(0);
+
+    for (std::size_t i = 0; i <= numSegments; ++i)
+    {
+        fan.push_back(float(i) / numSegments);
+        fan.push_back(1);
+    }
+
+    _vbo.setVertexData(&fan[0], 2, fan.size() / 2, GL_STATIC_DRAW);
+
+    _numSegments = numSegments;
+}
+
+
+} // namespace ofx
@@ -0,0 +1,103 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include <vector>
+#include "Light2D.h"
+#include "ofShader.h"
+#include "ofVbo.h"
+
+
+namespace ofx {
+
+
+// Draws many unshadowed lights with one instanced call.
+//
+// Every light is an instance of one shared unit fan, with as many segments
+// as Light2D::getNumSegments() gives the largest light in the batch.  The
+// position, angle, view angle, radius, color, bleed and linearize factor
+// of each light are stored in per-instance attributes, and the fan is
+// placed and attenuated on the GPU.  Needs the programmable renderer.
+class LightBatch2D
+{
+public:
+    LightBatch2D();
+    virtual ~LightBatch2D();
+
+    void clear();
+    void add(const Light2D& light);
+
+    std::size_t size() const;
+    bool empty() const;
+
+    // Draw every light added since the last clear().
+    void draw();
+
+    static bool isSupported();
+
+    static const std::string DEFAULT_VERTEX_SHADER_SRC;
+    static const std::string DEFAULT_FRAGMENT_SHADER_SRC;
+
+protected:
+    enum
+    {
+        POSITION_ATTRIBUTE = 4,
+        COLOR_ATTRIBUTE = 5,
+        PARAMETERS_ATTRIBUTE = 6
+    };
+
+    void setup();
+
+    // Rebuild the unit fan with the number of segments.
+    void setupFan(std::size_t numSegments);
+
+    // x, y, radius, unused.
+    std::vector<float> _positions;
+    std::vector<float> _colors;
+
+    // Start angle, view angle, bleed, linearize factor.
+    std::vector<float> _parameters;
+
+    // The attributes as last uploaded to the VBO.
+    std::vector<float> _uploadedPositions;
+    std::vector<float> _uploadedColors;
+    std::vector<float> _uploadedParameters;
+
+    float _maxRadius;
+
+    bool _isSetup;
+
+    std::size_t _numSegments;
+
+    ofVbo _vbo;
+    ofShader _shader;
+
+};
+
+
+} // namespace ofx
@@ -24,17 +24,132 @@
 
 
 #include "LightSystem2D.h"
+#include "AllocationCounter2D.h"
 #include "ofGraphics.h"
 #include "ofImage.h"
 #include "ofLog.h"
+#include "ofMath.h"
 #include "ofAppRunner.h"
 #include "ofEvents.h"
+#include "ofUtils.h"
+#include <limits>
+
+
+#define STRINGIFY(x) #x
 
 
 namespace ofx {
 
 
-LightSystem2D::LightSystem2D()
+const std::size_t LightSystem2D::DEFAULT_STATS_WINDOW_SIZE = 120;
+
+
+const std::string LightSystem2D::PENUMBRA_VERTEX_SHADER_SRC = "#version 150\n" STRINGIFY(
+
+uniform mat4 modelViewProjectionMatrix;
+
+in vec4 position;
+in vec2 texcoord;
+
+out vec2 fin;
+
+void main()
+{
+    fin = texcoord;
+    gl_Position = modelViewProjectionMatrix * position;
+}
+
+);
+
+
+const std::string LightSystem2D::PENUMBRA_FRAGMENT_SHADER_SRC = "#version 150\n" STRINGIFY(
+
+uniform float isBinary;
+
+in vec2 fin;
+
+out vec4 fragColor;
+
+void main()
+{
+    // The same as Light2D::getPenumbra().
+    float penumbra = clamp(fin.x / max(1.0 - fin.y, 0.0001), 0.0, 1.0);
+    penumbra = penumbra * penumbra * (3.0 - 2.0 * penumbra);
+
+    if (isBinary > 0.5 && penumbra >= 0.5)
+    {
+        discard;
+    }
+
+    fragColor = vec4(vec3(penumbra), 1.0);
+}
+
+);
+
+
+const std::string LightSystem2D::PENUMBRA_FIXED_FRAGMENT_SHADER_SRC = STRINGIFY(
+
+uniform float isBinary;
+
+void main()
+{
+    // The same as Light2D::getPenumbra().
+    vec2 fin = gl_TexCoord[0].st;
+
+    float penumbra = clamp(fin.x / max(1.0 - fin.y, 0.0001), 0.0, 1.0);
+    penumbra = penumbra * penumbra * (3.0 - 2.0 * penumbra);
+
+    if (isBinary > 0.5 && penumbra >= 0.5)
+    {
+        discard;
+    }
+
+    gl_FragColor = vec4(vec3(penumbra), 1.0);
+}
+
+);
+
+
+const std::string LightSystem2D::OCCLUDER_VERTEX_SHADER_SRC = "#version 150\n" STRINGIFY(
+
+uniform mat4 modelViewProjectionMatrix;
+
+in vec4 position;
+
+void main()
+{
+    gl_Position = modelViewProjectionMatrix * position;
+}
+
+);
+
+
+const std::string LightSystem2D::OCCLUDER_FRAGMENT_SHADER_SRC = "#version 150\n" STRINGIFY(
+
+out vec4 fragColor;
+
+void main()
+{
+    fragColor = vec4(1.0);
+}
+
+);
+
+
+LightSystem2D::LightSystem2D():
+    _frame(0),
+    _compositeMode(COMPOSITE_FBO),
+    _shadowMode(SHADOW_MASKS),
+    _lightmapScale(1),
+    _isInstancingEnabled(true),
+    _isCompactVerticesEnabled(true),
+    _isScissorEnabled(true),
+    _isDamageTrackingEnabled(true),
+    _stats(),
+    _statsHistoryIndex(0),
+    _allocationCount(0),
+    _statsWindowSize(DEFAULT_STATS_WINDOW_SIZE),
+    _areOccludersStale(true)
 {
     ofAddListener(ofEvents().setup, this, &LightSystem2D::setup);
     ofAddListener(ofEvents().update, this, &LightSystem2D::update);
@@ -61,6 +176,35 @@ void LightSystem2D::setup(ofEventArgs& args)
 
 void LightSystem2D::update(ofEventArgs& args)
 {
+    // The previous frame is complete once its draw has run.
+    if (_frame > 0 && _statsWindowSize > 0)
+    {
+        if (_statsHistory.size() < _statsWindowSize)
+        {
+            _statsHistory.push_back(_stats);
+        }
+        else
+        {
+            _statsHistory[_statsHistoryIndex] = _stats;
+        }
+
+        _statsHistoryIndex = (_statsHistoryIndex + 1) % _statsWindowSize;
+    }
+
+    _allocationCount = AllocationCounter2D::getCount();
+
+    ++_frame;
+
+    _profiler.beginFrame();
+
+    _stats = Stats();
+    _stats.gpuUploadTime = _profiler.getGpuTime(Profiler2D::PHASE_UPLOAD);
+    _stats.gpuLightTime = _profiler.getGpuTime(Profiler2D::PHASE_LIGHT);
+    _stats.gpuCompositeTime = _profiler.getGpuTime(Profiler2D::PHASE_COMPOSITE);
+    _stats.numLights = _lights.size();
+    _stats.numShapes = _shapes.size();
+    _stats.numPairs = _lights.size() * _shapes.size();
+
     Light2D::List::const_iterator lightIter = _lights.begin();
 
     while (lightIter != _lights.end())
@@ -76,244 +220,2873 @@ void LightSystem2D::update(ofEventArgs& args)
         (*shapeIter)->update();
         ++shapeIter;
     }
-}
 
+    _profiler.begin(Profiler2D::PHASE_MASK, false);
 
-void LightSystem2D::draw(ofEventArgs& args)
-{
-    _sceneComp.begin();
-    ofClear(0, 0, 0, 0);
-    _sceneComp.end();
+    _shapeGrid.update();
+    _store.update(_lights);
 
-    Light2D::List::const_iterator lightIter = _lights.begin();
+    // Batches are created here, on one thread, so that the workers never
+    // modify the batch map.
+    _batchQueue.clear();
+
+    lightIter = _lights.begin();
 
     while (lightIter != _lights.end())
     {
-        Shape2D::List::const_iterator shapeIter = _shapes.begin();
-
-        _lightComp.begin();
-        ofClear(0, 0, 0, 0);
-
-        (*lightIter)->draw();
-
-        ofPushStyle();
-        ofEnableBlendMode(OF_BLENDMODE_MULTIPLY);
-        while (shapeIter != _shapes.end())
+        // Out of view, the batch is kept as it was, and rebuilt if the
+        // light or its shapes changed once it is back in view.
+        if (!reachesViewport(**lightIter))
         {
-            ofMesh mesh;
-            makeMask(*lightIter, *shapeIter, mesh);
-            mesh.draw();
-            ++shapeIter;
+            ++_stats.numLightsCulled;
+        }
+        else if ((*lightIter)->getCastsShadows() && _shadowMode != SHADOW_POLAR)
+        {
+            ShadowBatch& batch = _shadowBatches[lightIter->get()];
+            batch.light = *lightIter;
+            batch.lightIndex = lightIter - _lights.begin();
+            _batchQueue.push_back(&batch);
+        }
+        else
+        {
+            _shadowBatches.erase(lightIter->get());
+            _stats.numPairsSkipped += _shapes.size();
         }
-        ofPopStyle();
-
-        _lightComp.end();
-
-        _sceneComp.begin();
-        ofPushStyle();
-        ofEnableBlendMode(OF_BLENDMODE_ADD);
-        _lightComp.draw(0, 0);
-        ofPopStyle();
-        _sceneComp.end();
 
         ++lightIter;
     }
 
-    _sceneComp.begin();
+    _workers.run(_batchQueue.size(), [this](std::size_t i) {
+        buildBatch(*_batchQueue[i]);
+    });
 
-    Shape2D::List::const_iterator shapeIter = _shapes.begin();
+    _stats.numPairsCulled = _stats.numPairs - _stats.numPairsSkipped;
 
-    while (shapeIter != _shapes.end())
+    for (std::size_t i = 0; i < _batchQueue.size(); ++i)
     {
-        (*shapeIter)->draw();
-        ++shapeIter;
+        _stats.numPairsCulled -= _batchQueue[i]->numPairsVisible;
+        _stats.numShadowsRebuilt += _batchQueue[i]->numShadowsRebuilt;
+        _stats.numShapesTested += _batchQueue[i]->numShapesTested;
+        _stats.shadowMemory += _batchQueue[i]->memory;
     }
-    _sceneComp.end();
 
-    _sceneComp.draw(0, 0);
+    // The store's damage is cleared by updateDamage().
+    _areOccludersStale = _areOccludersStale || !_store.getDamage().empty();
 
-}
+    updateStaticLayer();
+    updateDamage();
 
+    _profiler.end(Profiler2D::PHASE_MASK, false);
 
-void LightSystem2D::add(Light2D::SharedPtr light)
-{
-    _lights.push_back(light);
+    _stats.maskTime = _profiler.getCpuTime(Profiler2D::PHASE_MASK);
+    _stats.numUpdateAllocations = AllocationCounter2D::getCount() - _allocationCount;
+
+    _profiler.count("shapesTested", _stats.numShapesTested);
+    _profiler.count("shadowsRebuilt", _stats.numShadowsRebuilt);
 }
 
 
-void LightSystem2D::add(Shape2D::SharedPtr shape)
+void LightSystem2D::draw(ofEventArgs& args)
 {
-    _shapes.push_back(shape);
-}
+    _allocationCount = AllocationCounter2D::getCount();
 
+    _stats.numLightsDrawn = 0;
+    _stats.numShadowQuads = 0;
+    _stats.numVerticesUploaded = 0;
+    _stats.numBytesUploaded = 0;
+    _stats.numFboClears = 0;
+    _stats.numFboBinds = 0;
+    _stats.numDamageRects = 0;
+    _stats.numDamagePixels = 0;
 
-void LightSystem2D::add(const Light2D::List& lights)
-{
-    _lights.insert(_lights.end(), lights.begin(), lights.end());
+    drawStaticLayer();
+
+    if (isTiled() && (!_isDamageTrackingEnabled || !_damage.empty()))
+    {
+        updateTiledLights();
+    }
+
+    // Only the damaged parts of the scene are composited again, and an
+    // undamaged frame shows the last one.
+    if (_isDamageTrackingEnabled)
+    {
+        for (std::size_t i = 0; i < _damage.size(); ++i)
+        {
+            drawScene(_damage[i]);
+        }
+    }
+    else
+    {
+        drawScene(ofRectangle(0, 0, _sceneComp.getWidth(), _sceneComp.getHeight()));
+    }
+
+    _damage.clear();
+
+    _profiler.begin(Profiler2D::PHASE_COMPOSITE, true);
+    _sceneComp.draw(0, 0);
+    _profiler.end(Profiler2D::PHASE_COMPOSITE, true);
+
+    _stats.uploadTime = _profiler.getCpuTime(Profiler2D::PHASE_UPLOAD);
+    _stats.lightTime = _profiler.getCpuTime(Profiler2D::PHASE_LIGHT);
+    _stats.compositeTime = _profiler.getCpuTime(Profiler2D::PHASE_COMPOSITE);
+
+    _profiler.count("lightsDrawn", _stats.numLightsDrawn);
+    _profiler.count("shadowQuads", _stats.numShadowQuads);
+    _profiler.count("verticesUploaded", _stats.numVerticesUploaded);
+    _profiler.count("fboBinds", _stats.numFboBinds);
+    _profiler.count("damagePixels", _stats.numDamagePixels);
+
+    _stats.numDrawAllocations = AllocationCounter2D::getCount() - _allocationCount;
 }
 
 
-void LightSystem2D::add(const Shape2D::List& shapes)
+void LightSystem2D::drawScene(const ofRectangle& region)
 {
-    _shapes.insert(_shapes.end(), shapes.begin(), shapes.end());
-}
+    bool isPartial = region.x > 0 ||
+                     region.y > 0 ||
+                     region.width < _sceneComp.getWidth() ||
+                     region.height < _sceneComp.getHeight();
 
+    ++_stats.numDamageRects;
+    _stats.numDamagePixels += region.getArea();
 
+    // Lights are clipped to a partial region even when the scissor is
+    // otherwise off.
+    bool isScissorEnabled = _isScissorEnabled;
 
-void LightSystem2D::remove(Light2D::SharedPtr light)
-{
-    Light2D::List::iterator iter = std::find(_lights.begin(), _lights.end(), light);
+    _isScissorEnabled = _isScissorEnabled || isPartial;
 
-    if (iter != _lights.end())
+    _profiler.begin(Profiler2D::PHASE_COMPOSITE, true);
+
+    _sceneComp.begin();
+
+    if (isPartial)
     {
-        _lights.erase(iter);
+        beginScissor(region, _sceneComp);
     }
-}
 
+    ofClear(0, 0, 0, 0);
 
-void LightSystem2D::remove(Shape2D::SharedPtr shape)
-{
-    Shape2D::List::iterator iter = std::find(_shapes.begin(), _shapes.end(), shape);
+    ++_stats.numFboBinds;
+    ++_stats.numFboClears;
 
-    if (iter != _shapes.end())
+    // Every frame starts from the baked light of the static lights.
+    if (!_bakedLights.empty())
     {
-        _shapes.erase(iter);
+        ofPushStyle();
+        ofEnableBlendMode(OF_BLENDMODE_ADD);
+        _staticComp.draw(0, 0);
+        ofPopStyle();
     }
-}
 
+    if (isPartial)
+    {
+        endScissor();
+    }
 
-void LightSystem2D::remove(const Light2D::List& lights)
-{
-    Light2D::List::const_iterator lightIter = lights.begin();
+    // The stencil, visibility and tiled modes accumulate every light while
+    // the scene is bound.
+    bool isDirect = _compositeMode == COMPOSITE_STENCIL ||
+                    hasVisibilityPolygons() ||
+                    isTiled();
 
-    while (lightIter != lights.end())
+    if (!isDirect)
     {
-        remove(*lightIter);
-        ++lightIter;
+        _sceneComp.end();
     }
 
-}
+    _profiler.end(Profiler2D::PHASE_COMPOSITE, true);
 
+    bool isInstancing = _isInstancingEnabled && LightBatch2D::isSupported();
 
-void LightSystem2D::remove(const Shape2D::List& shapes)
-{
-    Shape2D::List::const_iterator shapeIter = shapes.begin();
+    _lightBatch.clear();
 
-    while (shapeIter != shapes.end())
+    // Tiled lights were added and uploaded once for all regions.
+    Light2D::List::const_iterator lightIter = isTiled() ? _lights.end() : _lights.begin();
+
+    while (lightIter != _lights.end())
     {
-        remove(*shapeIter);
-        ++shapeIter;
-    }
-}
+        if (!reachesViewport(**lightIter) ||
+            _bakedLights.find(lightIter->get()) != _bakedLights.end())
+        {
+            ++lightIter;
+            continue;
+        }
 
+        ShadowBatch* batch = 0;
 
-void LightSystem2D::clearLights()
-{
-    _lights.clear();
-}
+        ShadowBatchMap::iterator batchIter = _shadowBatches.find(lightIter->get());
 
+        if (batchIter != _shadowBatches.end())
+        {
+            batch = &batchIter->second;
+            uploadBatch(*batch);
+        }
 
-void LightSystem2D::clearShapes()
-{
-    _shapes.clear();
-}
+        ofRectangle rect = region;
 
+        if (_isScissorEnabled)
+        {
+            rect = getScissorRect(**lightIter, _sceneComp).getIntersection(region);
 
-void LightSystem2D::makeMask(Light2D::SharedPtr light,
-                             Shape2D::SharedPtr shape,
-                             ofMesh& mask)
-{
-    const ofPolyline& poly = shape->getShape();
+            // The light does not reach the region.
+            if (rect.isEmpty())
+            {
+                ++lightIter;
+                continue;
+            }
+        }
+
+        if (isInstancing && (!batch || batch->getMesh().getIndices().empty()))
+        {
+            // Drawn with the other unshadowed lights below.
+            _lightBatch.add(**lightIter);
+        }
+        else if (hasVisibilityPolygons())
+        {
+            drawLightVisibility(**lightIter, batch, rect);
+        }
+        else if (_compositeMode == COMPOSITE_STENCIL)
+        {
+            drawLightStencil(**lightIter, batch, rect);
+        }
+        else
+        {
+            drawLightFbo(**lightIter, batch, rect, _sceneComp);
+        }
 
-    // Create a list of all poly points that represent a "back facing" edge.
-    std::vector<bool> backFacing(poly.size());
+        ++_stats.numLightsDrawn;
 
-    for (std::size_t i = 0; i < poly.size(); ++i)
+        ++lightIter;
+    }
+
+    if (!isDirect)
+    {
+        _sceneComp.begin();
+        ++_stats.numFboBinds;
+    }
+
+    if (isPartial)
+    {
+        beginScissor(region, _sceneComp);
+    }
+
+    if (!_lightBatch.empty())
+    {
+        _profiler.begin(Profiler2D::PHASE_LIGHT, true);
+
+        ofPushStyle();
+        ofEnableBlendMode(OF_BLENDMODE_ADD);
+        _lightBatch.draw();
+        ofPopStyle();
+
+        _profiler.end(Profiler2D::PHASE_LIGHT, true);
+    }
+
+    if (isTiled() && !_tiledLights.empty())
     {
-        std::size_t next = (i + 1) % poly.size();
+        _profiler.begin(Profiler2D::PHASE_LIGHT, true);
 
-        ofVec2f firstVertex(poly[i].x,
-                            poly[i].y);
+        ofPushStyle();
+        ofEnableBlendMode(OF_BLENDMODE_ADD);
+        _tiledLights.draw(region);
+        ofPopStyle();
 
-        ofVec2f secondVertex(poly[next].x,
-                             poly[next].y);
+        _profiler.end(Profiler2D::PHASE_LIGHT, true);
+    }
 
-        ofVec2f middle = (firstVertex + secondVertex) / 2;
+    _profiler.begin(Profiler2D::PHASE_COMPOSITE, true);
 
-        ofVec2f lightVector = light->getPosition() - middle;
+    Shape2D::List::const_iterator shapeIter = _shapes.begin();
 
-        ofVec2f edgeNormal;
+    while (shapeIter != _shapes.end())
+    {
+        if (!isPartial || (*shapeIter)->getBoundingBox().intersects(region))
+        {
+            (*shapeIter)->draw();
+        }
 
-        edgeNormal.x = - (secondVertex.y - firstVertex.y);
-        edgeNormal.y =    secondVertex.x - firstVertex.x;
+        ++shapeIter;
+    }
 
-        backFacing[i] = (edgeNormal.dot(lightVector) > 0);
+    if (isPartial)
+    {
+        endScissor();
     }
 
-    std::size_t firstBoundaryIndex = std::numeric_limits<std::size_t>::max();
-    std::size_t secondBoundaryIndex = std::numeric_limits<std::size_t>::max();
+    _sceneComp.end();
+
+    _profiler.end(Profiler2D::PHASE_COMPOSITE, true);
 
-    for (std::size_t current = 0; current < poly.size(); ++current)
+    _isScissorEnabled = isScissorEnabled;
+}
+
+
+void LightSystem2D::uploadBatch(ShadowBatch& batch)
+{
+    const ofMesh& mesh = batch.getMesh();
+
+    if (batch.needsUpload && !mesh.getIndices().empty())
     {
-        std::size_t next = (current + 1) % poly.size();
+        _profiler.begin(Profiler2D::PHASE_UPLOAD, true);
+
+        batch.currentUploadBuffer = (batch.currentUploadBuffer + 1) % NUM_UPLOAD_BUFFERS;
+
+        UploadBuffer& buffer = batch.uploadBuffers[batch.currentUploadBuffer];
+
+        std::size_t numVertices = mesh.getNumVertices();
+        std::size_t numIndices = mesh.getNumIndices();
 
-        if (backFacing[current] != backFacing[next])
+        bool hasTexCoords = mesh.hasTexCoords();
+
+        // Reallocate only to grow or to change format.
+        bool isReallocated = numVertices > buffer.vertexCapacity ||
+                             _isCompactVerticesEnabled != buffer.isCompact ||
+                             hasTexCoords != buffer.hasTexCoords;
+
+        if (_isCompactVerticesEnabled)
         {
-            if (backFacing[next])
+            batch.compactVertices.resize(numVertices);
+
+            for (std::size_t i = 0; i < numVertices; ++i)
+            {
+                batch.compactVertices[i].set(mesh.getVertices()[i].x,
+                                             mesh.getVertices()[i].y);
+            }
+
+            if (isReallocated)
             {
-                secondBoundaryIndex = next;
+                buffer.vbo.disableColors();
+                buffer.vbo.setVertexData(&batch.compactVertices[0],
+                                         numVertices,
+                                         GL_DYNAMIC_DRAW);
             }
             else
             {
-                firstBoundaryIndex = next;
+                buffer.vbo.updateVertexData(&batch.compactVertices[0].x,
+                                            numVertices);
             }
+
+            _stats.numBytesUploaded += numVertices * sizeof(ofVec2f);
         }
-    }
+        else
+        {
+            // The original layout, for comparison and custom shaders.
+            batch.colors.resize(numVertices, ofFloatColor::black);
 
-    if (firstBoundaryIndex != std::numeric_limits<std::size_t>::max() &&
-        secondBoundaryIndex != std::numeric_limits<std::size_t>::max())
-    {
-        mask.setMode(OF_PRIMITIVE_TRIANGLE_STRIP);
+            if (isReallocated)
+            {
+                buffer.vbo.setVertexData(&mesh.getVertices()[0],
+                                         numVertices,
+                                         GL_DYNAMIC_DRAW);
+                buffer.vbo.setColorData(&batch.colors[0],
+                                        numVertices,
+                                        GL_DYNAMIC_DRAW);
+            }
+            else
+            {
+                buffer.vbo.updateVertexData(&mesh.getVertices()[0],
+                                            numVertices);
+                buffer.vbo.updateColorData(&batch.colors[0],
+                                           numVertices);
+            }
 
-        int numBoundaryEdges = firstBoundaryIndex - secondBoundaryIndex;
+            _stats.numBytesUploaded += numVertices * (sizeof(ofVec3f) + sizeof(ofFloatColor));
+        }
 
-        if (numBoundaryEdges < 0)
+        // Penumbra coordinates, if the light has a source radius.
+        if (hasTexCoords && isReallocated)
         {
-            numBoundaryEdges += poly.size();
+            buffer.vbo.setTexCoordData(&mesh.getTexCoords()[0],
+                                       numVertices,
+                                       GL_DYNAMIC_DRAW);
         }
-
-		for(std::size_t offset = 0; offset <= numBoundaryEdges; ++offset)
+        else if (hasTexCoords)
+        {
+            buffer.vbo.updateTexCoordData(&mesh.getTexCoords()[0],
+                                          numVertices);
+        }
+        else if (isReallocated)
         {
-            int boundaryIndex = (secondBoundaryIndex + offset) % poly.size();
+            buffer.vbo.disableTexCoords();
+        }
 
-            const ofVec2f& boundaryPoint = poly[boundaryIndex];
-            const ofVec2f& lightPoistion = light->getPosition();
+        if (hasTexCoords)
+        {
+            _stats.numBytesUploaded += numVertices * sizeof(ofVec2f);
+        }
 
-            // Create normalized ray from the light to the boundary point.
-            ofVec2f ray = boundaryPoint - lightPoistion;
+        if (isReallocated)
+        {
+            buffer.vertexCapacity = numVertices;
+            buffer.isCompact = _isCompactVerticesEnabled;
+            buffer.hasTexCoords = hasTexCoords;
+        }
 
-            // Normalize the ray.
-            ray.normalize();
+        if (numIndices > buffer.indexCapacity)
+        {
+            buffer.vbo.setIndexData(&mesh.getIndices()[0],
+                                    numIndices,
+                                    GL_DYNAMIC_DRAW);
+            buffer.indexCapacity = numIndices;
+        }
+        else
+        {
+            buffer.vbo.updateIndexData(&mesh.getIndices()[0],
+                                       numIndices);
+        }
+
+        buffer.numIndices = numIndices;
+
+        _profiler.end(Profiler2D::PHASE_UPLOAD, true);
+
+        _stats.numVerticesUploaded += numVertices;
+        _stats.numBytesUploaded += numIndices * sizeof(ofIndexType);
+    }
+
+    batch.needsUpload = false;
+}
+
+
+void LightSystem2D::drawShadows(const ShadowBatch& batch, bool isBinary)
+{
+    const UploadBuffer& buffer = batch.uploadBuffers[batch.currentUploadBuffer];
+
+    if (buffer.hasTexCoords)
+    {
+        if (!_penumbraShader.isLoaded())
+        {
+            setupPenumbraShader();
+        }
+
+        _penumbraShader.begin();
+        _penumbraShader.setUniform1f("isBinary", isBinary ? 1 : 0);
+        buffer.vbo.drawElements(GL_TRIANGLES, buffer.numIndices);
+        _penumbraShader.end();
+    }
+    else
+    {
+        // Masks are black; without a color array the current color is used.
+        ofPushStyle();
+        ofSetColor(0);
+        buffer.vbo.drawElements(GL_TRIANGLES, buffer.numIndices);
+        ofPopStyle();
+    }
+
+    _stats.numShadowQuads += buffer.numIndices / 6;
+}
+
+
+void LightSystem2D::drawLightFbo(Light2D& light,
+                                 const ShadowBatch* batch,
+                                 const ofRectangle& rect,
+                                 ofFbo& target)
+{
+    bool isReduced = _lightmapScale < 1;
+
+    // The part of the lightmap that covers the light's rectangle.
+    ofRectangle lightRect = getLightmapRect(rect);
+
+    _profiler.begin(Profiler2D::PHASE_LIGHT, true);
+
+    _lightComp.begin();
+
+    if (_isScissorEnabled)
+    {
+        beginScissor(lightRect, _lightComp);
+    }
+
+    ofClear(0, 0, 0, 0);
+
+    ++_stats.numFboBinds;
+    ++_stats.numFboClears;
+
+    // Lights that only override draw() still draw into a full lightmap.
+    if (isReduced)
+    {
+        ofPushMatrix();
+        ofScale(_lightmapScale, _lightmapScale);
+        light.draw(_lightmapScale);
+        ofPopMatrix();
+    }
+    else
+    {
+        light.draw();
+    }
+
+    // At full resolution the masks are multiplied into the light.  A
+    // reduced lightmap would blur them, so they are applied at full
+    // resolution with the stencil when compositing instead.
+    if (!isReduced && batch && !batch->getMesh().getIndices().empty())
+    {
+        ofPushStyle();
+        ofEnableBlendMode(OF_BLENDMODE_MULTIPLY);
+        drawShadows(*batch, false);
+        ofPopStyle();
+    }
+
+    if (_isScissorEnabled)
+    {
+        endScissor();
+    }
+
+    _lightComp.end();
+
+    _profiler.end(Profiler2D::PHASE_LIGHT, true);
+
+    _profiler.begin(Profiler2D::PHASE_COMPOSITE, true);
+
+    target.begin();
+
+    bool hasShadows = false;
+
+    if (isReduced)
+    {
+        beginScissor(rect, target);
+        hasShadows = beginShadowStencil(batch);
+    }
+
+    // Only the light's rectangle of _lightComp was written.  The bilinear
+    // upsample is enough for the light itself, which is smooth.
+    ofPushStyle();
+    ofEnableBlendMode(OF_BLENDMODE_ADD);
+    _lightComp.getTexture().drawSubsection(lightRect.x / _lightmapScale,
+                                           lightRect.y / _lightmapScale,
+                                           lightRect.width / _lightmapScale,
+                                           lightRect.height / _lightmapScale,
+                                           lightRect.x,
+                                           lightRect.y,
+                                           lightRect.width,
+                                           lightRect.height);
+    ofPopStyle();
+
+    if (hasShadows)
+    {
+        endShadowStencil();
+    }
+
+    if (isReduced)
+    {
+        endScissor();
+    }
+
+    target.end();
+
+    ++_stats.numFboBinds;
+
+    _profiler.end(Profiler2D::PHASE_COMPOSITE, true);
+}
+
+
+void LightSystem2D::drawLightStencil(Light2D& light,
+                                     const ShadowBatch* batch,
+                                     const ofRectangle& rect)
+{
+    _profiler.begin(Profiler2D::PHASE_LIGHT, true);
+
+    if (_isScissorEnabled)
+    {
+        beginScissor(rect, _sceneComp);
+    }
+
+    bool hasShadows = beginShadowStencil(batch);
+
+    // Add the light to the unshadowed pixels.
+    ofPushStyle();
+    ofEnableBlendMode(OF_BLENDMODE_ADD);
+    light.draw();
+    ofPopStyle();
+
+    if (hasShadows)
+    {
+        endShadowStencil();
+    }
+
+    if (_isScissorEnabled)
+    {
+        endScissor();
+    }
+
+    _profiler.end(Profiler2D::PHASE_LIGHT, true);
+}
+
+
+void LightSystem2D::drawLightVisibility(Light2D& light,
+                                        const ShadowBatch* batch,
+                                        const ofRectangle& rect)
+{
+    _profiler.begin(Profiler2D::PHASE_LIGHT, true);
+
+    if (_isScissorEnabled)
+    {
+        beginScissor(rect, _sceneComp);
+    }
+
+    ofPushStyle();
+    ofEnableBlendMode(OF_BLENDMODE_ADD);
+
+    // Without occluders in range the polygon is the light's own fan.
+    if (batch && !batch->getMesh().getIndices().empty())
+    {
+        const UploadBuffer& buffer = batch->uploadBuffers[batch->currentUploadBuffer];
+
+        light.begin(1);
+        buffer.vbo.drawElements(GL_TRIANGLES, buffer.numIndices);
+        light.end();
+    }
+    else
+    {
+        light.draw();
+    }
+
+    ofPopStyle();
+
+    if (_isScissorEnabled)
+    {
+        endScissor();
+    }
+
+    _profiler.end(Profiler2D::PHASE_LIGHT, true);
+}
+
+
+void LightSystem2D::setupPenumbraShader()
+{
+    if (ofIsGLProgrammableRenderer())
+    {
+        _penumbraShader.setupShaderFromSource(GL_VERTEX_SHADER, PENUMBRA_VERTEX_SHADER_SRC);
+        _penumbraShader.setupShaderFromSource(GL_FRAGMENT_SHADER, PENUMBRA_FRAGMENT_SHADER_SRC);
+        _penumbraShader.bindDefaults();
+    }
+    else
+    {
+        _penumbraShader.setupShaderFromSource(GL_FRAGMENT_SHADER, PENUMBRA_FIXED_FRAGMENT_SHADER_SRC);
+    }
+
+    _penumbraShader.linkProgram();
+}
+
+
+bool LightSystem2D::beginShadowStencil(const ShadowBatch* batch)
+{
+    if (!batch || batch->getMesh().getIndices().empty())
+    {
+        return false;
+    }
+
+    // Mark the shadowed pixels in the stencil buffer only.
+    glStencilMask(0xFF);
+    glClearStencil(0);
+    glClear(GL_STENCIL_BUFFER_BIT);
+
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    drawShadows(*batch, true);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glStencilFunc(GL_EQUAL, 0, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+
+    return true;
+}
+
+
+void LightSystem2D::endShadowStencil()
+{
+    glDisable(GL_STENCIL_TEST);
+}
+
+
+void LightSystem2D::add(Light2D::SharedPtr light)
+{
+    _lights.push_back(light);
+}
+
+
+void LightSystem2D::add(Shape2D::SharedPtr shape)
+{
+    _shapes.push_back(shape);
+    _shapeGrid.insert(shape);
+    _store.add(shape);
+}
+
+
+void LightSystem2D::add(const Light2D::List& lights)
+{
+    _lights.insert(_lights.end(), lights.begin(), lights.end());
+}
+
+
+void LightSystem2D::add(const Shape2D::List& shapes)
+{
+    _shapes.insert(_shapes.end(), shapes.begin(), shapes.end());
+
+    Shape2D::List::const_iterator shapeIter = shapes.begin();
+
+    while (shapeIter != shapes.end())
+    {
+        _shapeGrid.insert(*shapeIter);
+        _store.add(*shapeIter);
+        ++shapeIter;
+    }
+}
+
+
+
+void LightSystem2D::remove(Light2D::SharedPtr light)
+{
+    Light2D::List::iterator iter = std::find(_lights.begin(), _lights.end(), light);
+
+    if (iter != _lights.end())
+    {
+        _lights.erase(iter);
+        _shadowBatches.erase(light.get());
+    }
+}
+
+
+void LightSystem2D::remove(Shape2D::SharedPtr shape)
+{
+    Shape2D::List::iterator iter = std::find(_shapes.begin(), _shapes.end(), shape);
+
+    if (iter != _shapes.end())
+    {
+        _shapes.erase(iter);
+        _shapeGrid.remove(shape);
+        _store.remove(shape.get());
+
+        ShadowBatchMap::iterator batchIter = _shadowBatches.begin();
+
+        // A new shape could reuse the address, so forget the old key.
+        while (batchIter != _shadowBatches.end())
+        {
+            ShadowList& shadows = batchIter->second.shadows[batchIter->second.current];
+
+            for (std::size_t i = 0; i < shadows.size(); ++i)
+            {
+                if (shadows[i].shape == shape.get())
+                {
+                    shadows[i].shape = 0;
+                    batchIter->second.isDirty = true;
+                }
+            }
+
+            ++batchIter;
+        }
+    }
+}
+
+
+void LightSystem2D::remove(const Light2D::List& lights)
+{
+    Light2D::List::const_iterator lightIter = lights.begin();
+
+    while (lightIter != lights.end())
+    {
+        remove(*lightIter);
+        ++lightIter;
+    }
+
+}
+
+
+void LightSystem2D::remove(const Shape2D::List& shapes)
+{
+    Shape2D::List::const_iterator shapeIter = shapes.begin();
+
+    while (shapeIter != shapes.end())
+    {
+        remove(*shapeIter);
+        ++shapeIter;
+    }
+}
+
+
+void LightSystem2D::clearLights()
+{
+    _lights.clear();
+    _shadowBatches.clear();
+}
+
+
+void LightSystem2D::clearShapes()
+{
+    _shapes.clear();
+    _shapeGrid.clear();
+    _store.clearShapes();
+    _shadowBatches.clear();
+}
+
+
+void LightSystem2D::setNumThreads(std::size_t numThreads)
+{
+    _workers.setNumThreads(numThreads);
+}
+
+
+std::size_t LightSystem2D::getNumThreads() const
+{
+    return _workers.getNumThreads();
+}
+
+
+void LightSystem2D::setGridCellSize(float cellSize)
+{
+    _shapeGrid.setCellSize(cellSize);
+}
+
+
+float LightSystem2D::getGridCellSize() const
+{
+    return _shapeGrid.getCellSize();
+}
+
+
+void LightSystem2D::setCompositeMode(CompositeMode mode)
+{
+    if (mode != _compositeMode)
+    {
+        // Tiled lights keep visibility polygons and shadow maps instead of
+        // the shadow mode's geometry.
+        if (mode == COMPOSITE_TILED || _compositeMode == COMPOSITE_TILED)
+        {
+            _shadowBatches.clear();
+        }
+
+        _compositeMode = mode;
+        invalidateStaticLayer();
+        invalidate();
+    }
+}
+
+
+LightSystem2D::CompositeMode LightSystem2D::getCompositeMode() const
+{
+    return _compositeMode;
+}
+
+
+void LightSystem2D::setShadowMode(ShadowMode mode)
+{
+    if (mode != _shadowMode)
+    {
+        _shadowMode = mode;
+
+        // The cached geometry of one mode is meaningless to the other.
+        _shadowBatches.clear();
+        invalidateStaticLayer();
+        invalidate();
+    }
+}
+
+
+LightSystem2D::ShadowMode LightSystem2D::getShadowMode() const
+{
+    return _shadowMode;
+}
+
+
+void LightSystem2D::setLightmapScale(float scale)
+{
+    scale = ofClamp(scale, 0.0625f, 1.0f);
+
+    if (scale != _lightmapScale)
+    {
+        _lightmapScale = scale;
+
+        if (_sceneComp.isAllocated())
+        {
+            ofResizeEventArgs resize(_sceneComp.getWidth(), _sceneComp.getHeight());
+            windowResized(resize);
+        }
+    }
+}
+
+
+float LightSystem2D::getLightmapScale() const
+{
+    return _lightmapScale;
+}
+
+
+void LightSystem2D::setInstancingEnabled(bool enabled)
+{
+    _isInstancingEnabled = enabled;
+}
+
+
+bool LightSystem2D::isInstancingEnabled() const
+{
+    return _isInstancingEnabled;
+}
+
+
+void LightSystem2D::setCompactVerticesEnabled(bool enabled)
+{
+    _isCompactVerticesEnabled = enabled;
+}
+
+
+bool LightSystem2D::isCompactVerticesEnabled() const
+{
+    return _isCompactVerticesEnabled;
+}
+
+
+void LightSystem2D::setScissorEnabled(bool enabled)
+{
+    _isScissorEnabled = enabled;
+}
+
+
+bool LightSystem2D::isScissorEnabled() const
+{
+    return _isScissorEnabled;
+}
+
+
+void LightSystem2D::setDamageTrackingEnabled(bool enabled)
+{
+    _isDamageTrackingEnabled = enabled;
+    invalidate();
+}
+
+
+bool LightSystem2D::isDamageTrackingEnabled() const
+{
+    return _isDamageTrackingEnabled;
+}
+
+
+void LightSystem2D::invalidate()
+{
+    addDamage(ofRectangle(0, 0, _sceneComp.getWidth(), _sceneComp.getHeight()));
+}
+
+
+void LightSystem2D::setViewport(const ofRectangle& viewport)
+{
+    _viewport = viewport;
+}
+
+
+const ofRectangle& LightSystem2D::getViewport() const
+{
+    return _viewport;
+}
+
+
+const LightSystem2D::Stats& LightSystem2D::getStats() const
+{
+    return _stats;
+}
+
+
+void LightSystem2D::setStatsWindowSize(std::size_t numFrames)
+{
+    _statsWindowSize = numFrames;
+    _statsHistory.clear();
+    _statsHistoryIndex = 0;
+}
+
+
+std::size_t LightSystem2D::getStatsWindowSize() const
+{
+    return _statsWindowSize;
+}
+
+
+LightSystem2D::StatsSummary LightSystem2D::getStatsSummary() const
+{
+    StatsSummary summary;
+    summary.numFrames = _statsHistory.size();
+    summary.mean = Stats();
+    summary.min = Stats();
+    summary.max = Stats();
+
+    if (_statsHistory.empty())
+    {
+        return summary;
+    }
+
+    const double scale = 1.0 / _statsHistory.size();
+
+    summary.min = _statsHistory.front();
+    summary.max = _statsHistory.front();
+
+    std::vector<Stats>::const_iterator iter = _statsHistory.begin();
+
+    while (iter != _statsHistory.end())
+    {
+        summary.mean = combine(summary.mean, *iter, [scale](double a, double b) {
+            return a + b * scale;
+        });
+        summary.min = combine(summary.min, *iter, [](double a, double b) {
+            return std::min(a, b);
+        });
+        summary.max = combine(summary.max, *iter, [](double a, double b) {
+            return std::max(a, b);
+        });
+        ++iter;
+    }
+
+    return summary;
+}
+
+
+void LightSystem2D::setGpuTimingEnabled(bool enabled)
+{
+    _profiler.setGpuTimingEnabled(enabled);
+}
+
+
+bool LightSystem2D::isGpuTimingEnabled() const
+{
+    return _profiler.isGpuTimingEnabled();
+}
+
+
+void LightSystem2D::setTracing(bool tracing)
+{
+    _profiler.setTracing(tracing);
+}
+
+
+bool LightSystem2D::isTracing() const
+{
+    return _profiler.isTracing();
+}
+
+
+bool LightSystem2D::saveTrace(const std::string& path) const
+{
+    return _profiler.saveTrace(path);
+}
+
+
+void LightSystem2D::clearTrace()
+{
+    _profiler.clearTrace();
+}
+
+
+void LightSystem2D::buildBatch(ShadowBatch& batch) const
+{
+    const SceneStore2D::Lights& lights = _store.getLights();
+    const SceneStore2D::Shapes& shapes = _store.getShapes();
+    const SceneStore2D::Vertices& vertices = _store.getVertices();
+
+    float lightX = lights.x[batch.lightIndex];
+    float lightY = lights.y[batch.lightIndex];
+    float radius = lights.radius[batch.lightIndex];
+
+    Wedge wedge(lightX,
+                lightY,
+                radius,
+                lights.angle[batch.lightIndex],
+                lights.viewAngle[batch.lightIndex]);
+
+    batch.numShadowsRebuilt = 0;
+
+    batch.candidates.clear();
+    batch.numShapesTested = _shapeGrid.query(batch.light->getBoundingBox(),
+                                             batch.candidates);
+
+    batch.visibleShapes.clear();
+
+    // Keep only the shapes that touch the light's radius, and its wedge.
+    for (std::size_t i = 0; i < batch.candidates.size(); ++i)
+    {
+        uint32_t index = _store.getShapeIndex(batch.candidates[i]);
+
+        if (!intersects(lightX,
+                        lightY,
+                        radius,
+                        shapes.minX[index],
+                        shapes.minY[index],
+                        shapes.maxX[index],
+                        shapes.maxY[index]))
+        {
+            continue;
+        }
+
+        if (!wedge.isFull)
+        {
+            float cornersX[4] = { shapes.minX[index], shapes.maxX[index], shapes.maxX[index], shapes.minX[index] };
+            float cornersY[4] = { shapes.minY[index], shapes.minY[index], shapes.maxY[index], shapes.maxY[index] };
+
+            if (!intersects(wedge, cornersX, cornersY, 4))
+            {
+                continue;
+            }
+
+            // Bounds inside a convex wedge hold the whole shape, so only
+            // shapes on its sides have their outline tested.
+            bool isContained = wedge.cosHalfAngle >= 0;
+
+            for (int j = 0; j < 4 && isContained; ++j)
+            {
+                isContained = wedge.isInside(ofVec2f(cornersX[j], cornersY[j]));
+            }
+
+            std::size_t first = shapes.first[index];
+
+            if (!isContained &&
+                shapes.numLoops[index] > 0 &&
+                !intersects(wedge,
+                            &vertices.x[first],
+                            &vertices.y[first],
+                            _store.getLoops()[shapes.firstLoop[index]]))
+            {
+                continue;
+            }
+        }
+
+        batch.visibleShapes.push_back(index);
+    }
+
+    batch.numPairsVisible = batch.visibleShapes.size();
+    batch.numDynamicShapes = 0;
+
+    for (std::size_t i = 0; i < batch.visibleShapes.size(); ++i)
+    {
+        batch.numDynamicShapes += !shapes.isStatic[batch.visibleShapes[i]];
+    }
+
+    if (isChanged(batch))
+    {
+        if (hasVisibilityPolygons())
+        {
+            rebuildVisibility(batch);
+        }
+        else
+        {
+            rebuildBatch(batch);
+        }
+
+        if (_compositeMode == COMPOSITE_TILED)
+        {
+            TiledLights2D::makeShadowMap(batch.getMesh(), batch.shadowMap);
+        }
+    }
+
+    batch.memory = getMemorySize(batch.meshes[0]) +
+                   getMemorySize(batch.meshes[1]) +
+                   batch.shadowMap.capacity() * sizeof(float);
+}
+
+
+bool LightSystem2D::isChanged(const ShadowBatch& batch) const
+{
+    const ShadowList& shadows = batch.shadows[batch.current];
+
+    if (batch.isDirty || shadows.size() != batch.visibleShapes.size())
+    {
+        return true;
+    }
+
+    const SceneStore2D::Shapes& shapes = _store.getShapes();
+    std::size_t lightVersion = _store.getLights().version[batch.lightIndex];
+
+    for (std::size_t i = 0; i < shadows.size(); ++i)
+    {
+        uint32_t index = batch.visibleShapes[i];
+
+        if (shadows[i].shape != shapes.source[index] ||
+            shadows[i].lightVersion != lightVersion ||
+            shadows[i].shapeVersion != shapes.version[index])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void LightSystem2D::rebuildBatch(ShadowBatch& batch) const
+{
+    const SceneStore2D::Lights& lights = _store.getLights();
+    const SceneStore2D::Shapes& shapes = _store.getShapes();
+
+    const ShadowList& previousShadows = batch.shadows[batch.current];
+    const ofMesh& previousMesh = batch.meshes[batch.current];
+
+    std::size_t next = 1 - batch.current;
+
+    ShadowList& shadows = batch.shadows[next];
+    ofMesh& mesh = batch.meshes[next];
+
+    shadows.clear();
+    mesh.clear();
+    mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+
+    // Index the previous masks by shape so that unchanged ones are found.
+    batch.sortedShadows.resize(previousShadows.size());
+
+    for (std::size_t i = 0; i < previousShadows.size(); ++i)
+    {
+        batch.sortedShadows[i] = i;
+    }
+
+    std::sort(batch.sortedShadows.begin(),
+              batch.sortedShadows.end(),
+              [&previousShadows](uint32_t a, uint32_t b) {
+        return previousShadows[a].shape < previousShadows[b].shape;
+    });
+
+    std::size_t lightVersion = lights.version[batch.lightIndex];
+
+    // Build in spatial index order so that the result does not depend on
+    // the cache layout.
+    for (std::size_t i = 0; i < batch.visibleShapes.size(); ++i)
+    {
+        uint32_t index = batch.visibleShapes[i];
+
+        Shadow shadow;
+        shadow.shape = shapes.source[index];
+        shadow.lightVersion = lightVersion;
+        shadow.shapeVersion = shapes.version[index];
+        shadow.firstVertex = mesh.getNumVertices();
+        shadow.firstIndex = mesh.getNumIndices();
+
+        std::vector<uint32_t>::const_iterator iter =
+            std::lower_bound(batch.sortedShadows.begin(),
+                             batch.sortedShadows.end(),
+                             shadow.shape,
+                             [&previousShadows](uint32_t a, const Shape2D* shape) {
+                return previousShadows[a].shape < shape;
+            });
+
+        if (iter != batch.sortedShadows.end() &&
+            previousShadows[*iter].shape == shadow.shape &&
+            previousShadows[*iter].lightVersion == shadow.lightVersion &&
+            previousShadows[*iter].shapeVersion == shadow.shapeVersion)
+        {
+            copyShadow(previousShadows[*iter], previousMesh, mesh);
+        }
+        else
+        {
+            makeMask(lights.x[batch.lightIndex],
+                     lights.y[batch.lightIndex],
+                     lights.radius[batch.lightIndex],
+                     lights.sourceRadius[batch.lightIndex],
+                     _store.getVertices(),
+                     shapes.first[index],
+                     _store.getLoops().data() + shapes.firstLoop[index],
+                     shapes.numLoops[index],
+                     batch.backFacing,
+                     batch.runs,
+                     mesh);
+            ++batch.numShadowsRebuilt;
+        }
+
+        shadow.numVertices = mesh.getNumVertices() - shadow.firstVertex;
+        shadow.numIndices = mesh.getNumIndices() - shadow.firstIndex;
+
+        shadows.push_back(shadow);
+    }
+
+    batch.current = next;
+    batch.isDirty = false;
+    batch.needsUpload = true;
+    ++batch.generation;
+}
+
+
+void LightSystem2D::rebuildVisibility(ShadowBatch& batch) const
+{
+    const SceneStore2D::Lights& lights = _store.getLights();
+    const SceneStore2D::Shapes& shapes = _store.getShapes();
+    const SceneStore2D::Vertices& vertices = _store.getVertices();
+
+    std::size_t next = 1 - batch.current;
+
+    ShadowList& shadows = batch.shadows[next];
+    ofMesh& mesh = batch.meshes[next];
+
+    shadows.clear();
+    mesh.clear();
+
+    batch.visibility.clear();
+
+    std::size_t lightVersion = lights.version[batch.lightIndex];
+
+    // Any change moves the whole polygon, so every edge in range is swept.
+    for (std::size_t i = 0; i < batch.visibleShapes.size(); ++i)
+    {
+        uint32_t index = batch.visibleShapes[i];
+
+        Shadow shadow;
+        shadow.shape = shapes.source[index];
+        shadow.lightVersion = lightVersion;
+        shadow.shapeVersion = shapes.version[index];
+        shadow.firstVertex = 0;
+        shadow.numVertices = 0;
+        shadow.firstIndex = 0;
+        shadow.numIndices = 0;
+
+        shadows.push_back(shadow);
+
+        std::size_t first = shapes.first[index];
+        std::size_t numLoops = shapes.numLoops[index];
+
+        const uint32_t* loops = _store.getLoops().data() + shapes.firstLoop[index];
+
+        // A ray into a shape crosses an edge facing the light before any
+        // that faces away, so only the former are swept, unless the light
+        // is inside the shape.
+        bool isAround = isInsideShape(lights.x[batch.lightIndex],
+                                      lights.y[batch.lightIndex],
+                                      vertices,
+                                      first,
+                                      loops,
+                                      numLoops);
+
+        // Like the masks, a shape around the light, which faces away from it
+        // all around, casts no shadow.
+        for (std::size_t j = 0; j < numLoops; first += loops[j], ++j)
+        {
+            std::size_t count = loops[j];
+
+            if (count == 0)
+            {
+                continue;
+            }
+
+            batch.backFacing.resize(Silhouette2D::getNumWords(count));
+
+            Silhouette2D::classifyEdges(&vertices.normalX[first],
+                                        &vertices.normalY[first],
+                                        &vertices.offset[first],
+                                        count,
+                                        lights.x[batch.lightIndex],
+                                        lights.y[batch.lightIndex],
+                                        &batch.backFacing[0]);
+
+            if (isAround)
+            {
+                batch.runs.clear();
+
+                Silhouette2D::findRuns(&batch.backFacing[0], count, batch.runs);
+
+                if (numLoops == 1 && !batch.runs.empty() && batch.runs[0].count == count)
+                {
+                    continue;
+                }
+            }
+
+            for (std::size_t k = 0; k < count; ++k)
+            {
+                Silhouette2D::Word bit = Silhouette2D::Word(1) << (k % Silhouette2D::BITS_PER_WORD);
+
+                if (!isAround && (batch.backFacing[k / Silhouette2D::BITS_PER_WORD] & bit))
+                {
+                    continue;
+                }
+
+                std::size_t a = first + k;
+                std::size_t b = first + (k + 1) % count;
+
+                batch.visibility.addSegment(ofVec2f(vertices.x[a], vertices.y[a]),
+                                            ofVec2f(vertices.x[b], vertices.y[b]));
+            }
+        }
+    }
+
+    if (!batch.visibleShapes.empty())
+    {
+        float viewAngle = lights.viewAngle[batch.lightIndex];
+
+        batch.visibility.compute(ofVec2f(lights.x[batch.lightIndex],
+                                         lights.y[batch.lightIndex]),
+                                 lights.radius[batch.lightIndex],
+                                 lights.angle[batch.lightIndex] - viewAngle / 2,
+                                 viewAngle,
+                                 mesh);
+    }
+
+    batch.numShadowsRebuilt += batch.visibleShapes.size();
+
+    batch.current = next;
+    batch.isDirty = false;
+    batch.needsUpload = true;
+    ++batch.generation;
+}
+
+
+void LightSystem2D::makeMask(float lightX,
+                             float lightY,
+                             float radius,
+                             float sourceRadius,
+                             const SceneStore2D::Vertices& vertices,
+                             std::size_t first,
+                             const uint32_t* loops,
+                             std::size_t numLoops,
+                             std::vector<Silhouette2D::Word>& backFacing,
+                             std::vector<Silhouette2D::Run>& runs,
+                             ofMesh& mask)
+{
+    // Every run of every loop is extruded, so a concave shape, or one with
+    // holes, casts its whole shadow in one mask.
+    for (std::size_t i = 0; i < numLoops; first += loops[i], ++i)
+    {
+        std::size_t count = loops[i];
+
+        if (count == 0)
+        {
+            continue;
+        }
+
+        // Mark every edge that is "back facing" as seen from the light.
+        backFacing.resize(Silhouette2D::getNumWords(count));
+
+        Silhouette2D::classifyEdges(&vertices.normalX[first],
+                                    &vertices.normalY[first],
+                                    &vertices.offset[first],
+                                    count,
+                                    lightX,
+                                    lightY,
+                                    &backFacing[0]);
+
+        runs.clear();
+
+        Silhouette2D::findRuns(&backFacing[0], count, runs);
+
+        for (std::size_t j = 0; j < runs.size(); ++j)
+        {
+            // A shape around the light casts no shadow.  Around a light in
+            // one of its holes, the outline shadows everything outside it.
+            if (runs[j].count == count && numLoops == 1)
+            {
+                continue;
+            }
+
+            extrudeRun(lightX,
+                       lightY,
+                       radius,
+                       sourceRadius,
+                       vertices,
+                       first,
+                       count,
+                       runs[j],
+                       mask);
+        }
+    }
+}
+
+
+bool LightSystem2D::isInsideShape(float x,
+                                  float y,
+                                  const SceneStore2D::Vertices& vertices,
+                                  std::size_t first,
+                                  const uint32_t* loops,
+                                  std::size_t numLoops)
+{
+    bool isInside = false;
+
+    for (std::size_t i = 0; i < numLoops; first += loops[i], ++i)
+    {
+        for (std::size_t j = 0, k = loops[i] - 1; j < loops[i]; k = j++)
+        {
+            float ax = vertices.x[first + j];
+            float ay = vertices.y[first + j];
+            float bx = vertices.x[first + k];
+            float by = vertices.y[first + k];
+
+            if ((ay > y) != (by > y) && x < ax + (bx - ax) * (y - ay) / (by - ay))
+            {
+                isInside = !isInside;
+            }
+        }
+    }
+
+    return isInside;
+}
+
+
+void LightSystem2D::extrudeRun(float lightX,
+                               float lightY,
+                               float radius,
+                               float sourceRadius,
+                               const SceneStore2D::Vertices& vertices,
+                               std::size_t first,
+                               std::size_t count,
+                               const Silhouette2D::Run& run,
+                               ofMesh& mask)
+{
+    mask.setMode(OF_PRIMITIVE_TRIANGLES);
+
+    int numBoundaryEdges = run.count;
+
+    ofVec2f light(lightX, lightY);
+
+    // Every mask of a soft light has texture coordinates, so that they
+    // stay in step with the vertices of the batch.
+    bool hasTexCoords = sourceRadius > 0;
+    bool isSoft = hasTexCoords && run.count < count;
+
+    // With a source of some size, the umbra is bounded by the rays from
+    // the far side of the source past the two ends of the silhouette,
+    // and a fin on each end fades out to the rays from the near side.
+    std::size_t endIndices[2] = {
+        first + run.first,
+        first + (run.first + run.count) % count
+    };
+
+    ofVec2f ends[2];
+    ofVec2f innerRays[2];
+    ofVec2f outerRays[2];
+
+    for (int i = 0; i < 2; ++i)
+    {
+        ends[i].set(vertices.x[endIndices[i]], vertices.y[endIndices[i]]);
+    }
+
+    if (isSoft)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            ofVec2f toEnd = ends[i] - light;
+            float distance = toEnd.length();
+
+            // The side of the source away from the rest of the shadow.
+            ofVec2f normal = ofVec2f(-toEnd.y, toEnd.x) / distance;
+
+            if (normal.dot(ends[1 - i] - ends[i]) < 0)
+            {
+                normal = -normal;
+            }
+
+            ofVec2f offset = normal * std::min(sourceRadius, 0.9f * distance);
+
+            innerRays[i] = (toEnd + offset).getNormalized();
+            outerRays[i] = (toEnd - offset).getNormalized();
+        }
+    }
+
+    // The turn from the first end to the second, and of the umbra's
+    // edges.  While they agree, the rays in between are kept inside the
+    // umbra so that they do not cover the fins.
+    ofVec2f toFirst = ends[0] - light;
+    ofVec2f toSecond = ends[1] - light;
+
+    float turn = toFirst.x * toSecond.y - toFirst.y * toSecond.x;
+    float umbraTurn = innerRays[0].x * innerRays[1].y - innerRays[0].y * innerRays[1].x;
+
+    bool isClamped = isSoft && turn * umbraTurn > 0;
+
+    auto getRay = [&](const ofVec2f& point, int end) -> ofVec2f {
+        if (isSoft && end >= 0)
+        {
+            return innerRays[end];
+        }
+
+        ofVec2f ray = (point - light).getNormalized();
+
+        if (isClamped)
+        {
+            if ((innerRays[0].x * ray.y - innerRays[0].y * ray.x) * turn < 0)
+            {
+                ray = innerRays[0];
+            }
+            else if ((ray.x * innerRays[1].y - ray.y * innerRays[1].x) * turn < 0)
+            {
+                ray = innerRays[1];
+            }
+        }
+
+        return ray;
+    };
+
+    // Shadows end on a polygon around the light's circle, as fine as the
+    // light's fan, rather than at a fixed distance past the shape.
+    std::size_t numSegments = Light2D::getNumSegments(radius, TWO_PI);
+
+    float step = TWO_PI / numSegments;
+    float reach = radius / cos(step / 2);
+
+    ofIndexType previousIndex = 0;
+    bool hasPrevious = false;
+
+    // Two triangles per boundary edge, joining its ends to their
+    // extrusions.  The part of an edge outside the circle casts no
+    // shadow inside it and is clipped away.
+    for (int offset = 0; offset < numBoundaryEdges; ++offset)
+    {
+        std::size_t index0 = first + (run.first + offset) % count;
+        std::size_t index1 = first + (run.first + offset + 1) % count;
+
+        ofVec2f point0(vertices.x[index0], vertices.y[index0]);
+        ofVec2f point1(vertices.x[index1], vertices.y[index1]);
+
+        float from = 0;
+        float to = 1;
+
+        if (!clip(light, reach, point0, point1, from, to))
+        {
+            hasPrevious = false;
+            continue;
+        }
+
+        ofIndexType startIndex = previousIndex;
+
+        // Consecutive edges share their unclipped ends.
+        if (!hasPrevious || from > 0)
+        {
+            ofVec2f start = point0 + (point1 - point0) * from;
+
+            startIndex = extrude(light,
+                                 reach,
+                                 start,
+                                 getRay(start, offset == 0 && from == 0 ? 0 : -1),
+                                 hasTexCoords,
+                                 mask);
+        }
+
+        ofVec2f end = point0 + (point1 - point0) * to;
+
+        ofIndexType endIndex = extrude(light,
+                                       reach,
+                                       end,
+                                       getRay(end, offset + 1 == numBoundaryEdges && to == 1 ? 1 : -1),
+                                       hasTexCoords,
+                                       mask);
+
+        mask.addIndex(startIndex);
+        mask.addIndex(startIndex + 1);
+        mask.addIndex(endIndex);
+
+        mask.addIndex(startIndex + 1);
+        mask.addIndex(endIndex + 1);
+        mask.addIndex(endIndex);
+
+        addFarCap(light, step, startIndex + 1, endIndex + 1, hasTexCoords, mask);
+
+        previousIndex = endIndex;
+        hasPrevious = to == 1;
+    }
+
+    if (isSoft)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            // An end outside the circle lights nothing past it.
+            if (ends[i].squareDistance(light) >= reach * reach)
+            {
+                continue;
+            }
+
+            ofIndexType index = mask.getNumVertices();
+
+            mask.addVertex(ends[i]);
+            mask.addVertex(getFarPoint(light, reach, ends[i], innerRays[i]));
+            mask.addVertex(getFarPoint(light, reach, ends[i], outerRays[i]));
+
+            mask.addTexCoord(ofVec2f(0, 1));
+            mask.addTexCoord(ofVec2f(0, 0));
+            mask.addTexCoord(ofVec2f(1, 0));
+
+            mask.addIndex(index);
+            mask.addIndex(index + 1);
+            mask.addIndex(index + 2);
+        }
+    }
+}
+
+
+bool LightSystem2D::clip(const ofVec2f& light,
+                         float reach,
+                         const ofVec2f& a,
+                         const ofVec2f& b,
+                         float& from,
+                         float& to)
+{
+    ofVec2f edge = b - a;
+    ofVec2f offset = a - light;
+
+    float c = offset.lengthSquared() - reach * reach;
+
+    // Both ends inside, the usual case.
+    if (c <= 0 && (b - light).lengthSquared() <= reach * reach)
+    {
+        from = 0;
+        to = 1;
+        return true;
+    }
+
+    float A = edge.lengthSquared();
+    float B = 2 * offset.dot(edge);
+    float discriminant = B * B - 4 * A * c;
+
+    if (A <= 0 || discriminant <= 0)
+    {
+        return false;
+    }
+
+    float root = sqrt(discriminant);
+
+    from = std::max((-B - root) / (2 * A), 0.0f);
+    to = std::min((-B + root) / (2 * A), 1.0f);
+
+    return from < to;
+}
+
+
+ofVec2f LightSystem2D::getFarPoint(const ofVec2f& light,
+                                   float reach,
+                                   const ofVec2f& point,
+                                   const ofVec2f& ray)
+{
+    // The positive root of |point + ray * t - light| = reach.
+    ofVec2f offset = point - light;
+
+    float b = offset.dot(ray);
+    float c = offset.lengthSquared() - reach * reach;
+
+    float t = -b + sqrt(std::max(b * b - c, 0.0f));
+
+    return point + ray * std::max(t, 0.0f);
+}
+
+
+ofIndexType LightSystem2D::extrude(const ofVec2f& light,
+                                   float reach,
+                                   const ofVec2f& point,
+                                   const ofVec2f& ray,
+                                   bool hasTexCoords,
+                                   ofMesh& mask)
+{
+    ofIndexType index = mask.getNumVertices();
+
+    mask.addVertex(point);
+    mask.addVertex(getFarPoint(light, reach, point, ray));
+
+    if (hasTexCoords)
+    {
+        mask.addTexCoord(ofVec2f(0, 0));
+        mask.addTexCoord(ofVec2f(0, 0));
+    }
+
+    return index;
+}
+
+
+void LightSystem2D::addFarCap(const ofVec2f& light,
+                              float step,
+                              ofIndexType firstIndex,
+                              ofIndexType lastIndex,
+                              bool hasTexCoords,
+                              ofMesh& mask)
+{
+    ofVec2f first = mask.getVertices()[firstIndex] - light;
+    ofVec2f last = mask.getVertices()[lastIndex] - light;
+
+    float angle = atan2(first.x * last.y - first.y * last.x, first.dot(last));
+
+    // A chord of at most one step stays outside the circle.
+    int numPoints = std::ceil(std::abs(angle) / step) - 1;
+
+    if (numPoints <= 0)
+    {
+        return;
+    }
+
+    // Fan from the first far point over points on the arc, which all lie
+    // on the same circle and so make a convex polygon.
+    ofIndexType previousIndex = lastIndex;
+
+    for (int i = 1; i <= numPoints; ++i)
+    {
+        ofIndexType index = mask.getNumVertices();
+
+        mask.addVertex(light + first.getRotatedRad(angle * i / (numPoints + 1)));
+
+        if (hasTexCoords)
+        {
+            mask.addTexCoord(ofVec2f(0, 0));
+        }
+
+        if (i > 1)
+        {
+            mask.addIndex(firstIndex);
+            mask.addIndex(previousIndex);
+            mask.addIndex(index);
+        }
+
+        previousIndex = index;
+    }
+
+    mask.addIndex(firstIndex);
+    mask.addIndex(previousIndex);
+    mask.addIndex(lastIndex);
+}
+
+
+void LightSystem2D::copyShadow(const Shadow& shadow,
+                               const ofMesh& source,
+                               ofMesh& target)
+{
+    std::size_t firstVertex = target.getNumVertices();
+
+    std::vector<ofVec3f>::const_iterator vertices = source.getVertices().begin() + shadow.firstVertex;
+
+    target.getVertices().insert(target.getVertices().end(),
+                                vertices,
+                                vertices + shadow.numVertices);
+
+    if (source.hasTexCoords())
+    {
+        std::vector<ofVec2f>::const_iterator texCoords = source.getTexCoords().begin() + shadow.firstVertex;
+
+        target.getTexCoords().insert(target.getTexCoords().end(),
+                                     texCoords,
+                                     texCoords + shadow.numVertices);
+    }
+
+    for (std::size_t i = 0; i < shadow.numIndices; ++i)
+    {
+        ofIndexType index = source.getIndices()[shadow.firstIndex + i];
+        target.getIndices().push_back(index - shadow.firstVertex + firstVertex);
+    }
+}
+
+
+ofFloatColor LightSystem2D::evaluate(const ofVec2f& point) const
+{
+    ofFloatColor result(0, 0, 0, 0);
+
+    Light2D::List::const_iterator lightIter = _lights.begin();
+
+    while (lightIter != _lights.end())
+    {
+        const Light2D& light = *(*lightIter);
+
+        float attenuation = reachesViewport(light) ? light.getAttenuation(point) : 0;
+
+        ShadowBatchMap::const_iterator batchIter = _shadowBatches.find(&light);
+
+        if (attenuation > 0 && batchIter != _shadowBatches.end())
+        {
+            const ofMesh& mesh = batchIter->second.getMesh();
+            const std::vector<ofIndexType>& indices = mesh.getIndices();
+
+            // Shadow masks darken the point, a visibility polygon lights it.
+            bool isVisibility = hasVisibilityPolygons();
+            bool isInsideAny = false;
+
+            for (std::size_t i = 0; i + 2 < indices.size() && attenuation > 0; i += 3)
+            {
+                if (isInside(point,
+                             mesh.getVertices()[indices[i]],
+                             mesh.getVertices()[indices[i + 1]],
+                             mesh.getVertices()[indices[i + 2]]))
+                {
+                    isInsideAny = true;
+
+                    if (isVisibility)
+                    {
+                        break;
+                    }
+
+                    // Overlapping masks multiply, like their blend mode.
+                    attenuation *= getTransmittance(point, mesh, i);
+                }
+            }
+
+            if (isVisibility && !indices.empty() && !isInsideAny)
+            {
+                attenuation = 0;
+            }
+        }
+
+        result += light.getColor() * attenuation;
+
+        ++lightIter;
+    }
+
+    // Lights are accumulated in 8-bit targets.
+    result.r = ofClamp(result.r, 0, 1);
+    result.g = ofClamp(result.g, 0, 1);
+    result.b = ofClamp(result.b, 0, 1);
+    result.a = ofClamp(result.a, 0, 1);
+
+    return result;
+}
+
+
+void LightSystem2D::evaluate(const ofRectangle& region,
+                             ofFloatPixels& pixels) const
+{
+    const int width = pixels.getWidth();
+    const int height = pixels.getHeight();
+    const int numChannels = std::min<int>(pixels.getNumChannels(), 4);
+
+    if (width == 0 || height == 0 || region.width == 0 || region.height == 0)
+    {
+        return;
+    }
+
+    const float cellWidth = region.width / width;
+    const float cellHeight = region.height / height;
+
+    std::vector<ofFloatColor> accumulator(width * height, ofFloatColor(0, 0, 0, 0));
+    std::vector<float> transmittance;
+
+    Light2D::List::const_iterator lightIter = _lights.begin();
+
+    while (lightIter != _lights.end())
+    {
+        const Light2D& light = *(*lightIter);
+        const ofRectangle box = light.getBoundingBox();
+
+        // The window of sample points that lie inside the light's bounds.
+        int minX = std::max(0, (int)std::ceil((box.getMinX() - region.x) / cellWidth - 0.5f));
+        int maxX = std::min(width - 1, (int)std::floor((box.getMaxX() - region.x) / cellWidth - 0.5f));
+        int minY = std::max(0, (int)std::ceil((box.getMinY() - region.y) / cellHeight - 0.5f));
+        int maxY = std::min(height - 1, (int)std::floor((box.getMaxY() - region.y) / cellHeight - 0.5f));
+
+        if (minX > maxX || minY > maxY || !reachesViewport(light))
+        {
+            ++lightIter;
+            continue;
+        }
+
+        const int windowWidth = maxX - minX + 1;
+
+        ShadowBatchMap::const_iterator batchIter = _shadowBatches.find(&light);
+
+        // A visibility polygon lights the samples it covers, where masks
+        // shadow them.
+        bool isVisibility = hasVisibilityPolygons() &&
+                            batchIter != _shadowBatches.end() &&
+                            !batchIter->second.getMesh().getIndices().empty();
+
+        transmittance.assign(windowWidth * (maxY - minY + 1), isVisibility ? 0 : 1);
+
+        if (batchIter != _shadowBatches.end())
+        {
+            // Mark the samples covered by each triangle, visiting only the
+            // samples inside the triangle's bounds.
+            const ofMesh& mesh = batchIter->second.getMesh();
+            const std::vector<ofVec3f>& vertices = mesh.getVertices();
+            const std::vector<ofIndexType>& indices = mesh.getIndices();
+
+            for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+            {
+                const ofVec3f& a = vertices[indices[i]];
+                const ofVec3f& b = vertices[indices[i + 1]];
+                const ofVec3f& c = vertices[indices[i + 2]];
+
+                float triangleMinX = std::min(a.x, std::min(b.x, c.x));
+                float triangleMaxX = std::max(a.x, std::max(b.x, c.x));
+                float triangleMinY = std::min(a.y, std::min(b.y, c.y));
+                float triangleMaxY = std::max(a.y, std::max(b.y, c.y));
+
+                int x0 = std::max(minX, (int)std::ceil((triangleMinX - region.x) / cellWidth - 0.5f));
+                int x1 = std::min(maxX, (int)std::floor((triangleMaxX - region.x) / cellWidth - 0.5f));
+                int y0 = std::max(minY, (int)std::ceil((triangleMinY - region.y) / cellHeight - 0.5f));
+                int y1 = std::min(maxY, (int)std::floor((triangleMaxY - region.y) / cellHeight - 0.5f));
+
+                for (int y = y0; y <= y1; ++y)
+                {
+                    for (int x = x0; x <= x1; ++x)
+                    {
+                        ofVec2f point(region.x + (x + 0.5f) * cellWidth,
+                                      region.y + (y + 0.5f) * cellHeight);
+
+                        if (isInside(point, a, b, c))
+                        {
+                            float& sample = transmittance[(y - minY) * windowWidth + (x - minX)];
+
+                            sample = isVisibility ? 1 : sample * getTransmittance(point, mesh, i);
+                        }
+                    }
+                }
+            }
+        }
+
+        const ofFloatColor color = light.getColor();
+
+        for (int y = minY; y <= maxY; ++y)
+        {
+            for (int x = minX; x <= maxX; ++x)
+            {
+                float sample = transmittance[(y - minY) * windowWidth + (x - minX)];
+
+                if (sample > 0)
+                {
+                    ofVec2f point(region.x + (x + 0.5f) * cellWidth,
+                                  region.y + (y + 0.5f) * cellHeight);
+
+                    accumulator[y * width + x] += color * (light.getAttenuation(point) * sample);
+                }
+            }
+        }
+
+        ++lightIter;
+    }
+
+    float* data = pixels.getData();
+
+    for (std::size_t i = 0; i < accumulator.size(); ++i)
+    {
+        const ofFloatColor& color = accumulator[i];
+
+        float channels[4] = {
+            ofClamp(color.r, 0, 1),
+            ofClamp(color.g, 0, 1),
+            ofClamp(color.b, 0, 1),
+            ofClamp(color.a, 0, 1)
+        };
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            data[i * pixels.getNumChannels() + channel] = channels[channel];
+        }
+    }
+}
+
+
+void LightSystem2D::render(const ofRectangle& region, ofFloatPixels& pixels)
+{
+    _softwareRenderer.clear();
+
+    Light2D::List::const_iterator lightIter = _lights.begin();
+
+    while (lightIter != _lights.end())
+    {
+        if (!reachesViewport(**lightIter))
+        {
+            ++lightIter;
+            continue;
+        }
+
+        ShadowBatchMap::const_iterator batchIter = _shadowBatches.find(lightIter->get());
+
+        if (hasVisibilityPolygons() &&
+            batchIter != _shadowBatches.end() &&
+            !batchIter->second.getMesh().getIndices().empty())
+        {
+            _softwareRenderer.addRegion(*(*lightIter), batchIter->second.getMesh());
+        }
+        else
+        {
+            _softwareRenderer.add(*(*lightIter),
+                                  batchIter != _shadowBatches.end() ? &batchIter->second.getMesh() : 0);
+        }
+
+        ++lightIter;
+    }
+
+    _softwareRenderer.render(region, pixels, _workers);
+}
+
+
+bool LightSystem2D::intersects(float lightX,
+                               float lightY,
+                               float radius,
+                               float minX,
+                               float minY,
+                               float maxX,
+                               float maxY)
+{
+    // Distance from the light to the closest point of the rectangle.
+    float dx = lightX - ofClamp(lightX, minX, maxX);
+    float dy = lightY - ofClamp(lightY, minY, maxY);
+
+    return (dx * dx + dy * dy) <= (radius * radius);
+}
+
+
+bool LightSystem2D::intersects(const Wedge& wedge,
+                               const float* x,
+                               const float* y,
+                               std::size_t count)
+{
+    if (count == 0)
+    {
+        return false;
+    }
+
+    // A vertex in the wedge.
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (wedge.isInside(ofVec2f(x[i], y[i])))
+        {
+            return true;
+        }
+    }
+
+    // Otherwise the two touch only if the light is inside the polygon or
+    // an edge crosses a side or the arc of the wedge.
+    bool isLightInside = false;
+
+    ofVec2f startPoint = wedge.center + wedge.start * wedge.radius;
+    ofVec2f endPoint = wedge.center + wedge.end * wedge.radius;
+
+    for (std::size_t i = 0, j = count - 1; i < count; j = i++)
+    {
+        ofVec2f a(x[j], y[j]);
+        ofVec2f b(x[i], y[i]);
+
+        if ((a.y > wedge.center.y) != (b.y > wedge.center.y) &&
+            wedge.center.x < (b.x - a.x) * (wedge.center.y - a.y) / (b.y - a.y) + a.x)
+        {
+            isLightInside = !isLightInside;
+        }
+
+        if (!wedge.isFull &&
+            (intersects(wedge.center, startPoint, a, b) ||
+             intersects(wedge.center, endPoint, a, b)))
+        {
+            return true;
+        }
+
+        ofVec2f edge = b - a;
+        ofVec2f offset = a - wedge.center;
+
+        float A = edge.lengthSquared();
+        float B = 2 * offset.dot(edge);
+        float C = offset.lengthSquared() - wedge.radius * wedge.radius;
+        float discriminant = B * B - 4 * A * C;
+
+        if (A <= 0 || discriminant < 0)
+        {
+            continue;
+        }
+
+        float root = sqrt(discriminant);
+        float ts[2] = { (-B - root) / (2 * A), (-B + root) / (2 * A) };
+
+        for (int k = 0; k < 2; ++k)
+        {
+            if (ts[k] >= 0 && ts[k] <= 1 &&
+                (wedge.isFull ||
+                 (offset + edge * ts[k]).dot(wedge.direction) >= wedge.cosHalfAngle * wedge.radius))
+            {
+                return true;
+            }
+        }
+    }
+
+    return isLightInside;
+}
+
+
+bool LightSystem2D::intersects(const ofVec2f& a,
+                               const ofVec2f& b,
+                               const ofVec2f& c,
+                               const ofVec2f& d)
+{
+    ofVec2f ab = b - a;
+    ofVec2f cd = d - c;
+
+    float c0 = ab.x * (c.y - a.y) - ab.y * (c.x - a.x);
+    float d0 = ab.x * (d.y - a.y) - ab.y * (d.x - a.x);
+    float a0 = cd.x * (a.y - c.y) - cd.y * (a.x - c.x);
+    float b0 = cd.x * (b.y - c.y) - cd.y * (b.x - c.x);
+
+    // Collinear segments count as touching, which only keeps a shape.
+    return c0 * d0 <= 0 && a0 * b0 <= 0;
+}
+
+
+bool LightSystem2D::reachesViewport(const Light2D& light) const
+{
+    ofRectangle viewport = _viewport;
+
+    if (viewport.isEmpty())
+    {
+        viewport.set(0, 0, _sceneComp.getWidth(), _sceneComp.getHeight());
+
+        if (viewport.isEmpty())
+        {
+            return true;
+        }
+    }
+
+    return intersects(light.getPosition().x,
+                      light.getPosition().y,
+                      light.getRadius(),
+                      viewport.getMinX(),
+                      viewport.getMinY(),
+                      viewport.getMaxX(),
+                      viewport.getMaxY());
+}
+
+
+LightSystem2D::Wedge::Wedge(float x,
+                            float y,
+                            float radius,
+                            float angle,
+                            float viewAngle):
+    center(x, y),
+    radius(radius),
+    direction(cos(angle), sin(angle)),
+    start(cos(angle - viewAngle / 2), sin(angle - viewAngle / 2)),
+    end(cos(angle + viewAngle / 2), sin(angle + viewAngle / 2)),
+    cosHalfAngle(cos(viewAngle / 2)),
+    isFull(viewAngle >= TWO_PI)
+{
+}
+
+
+bool LightSystem2D::Wedge::isInside(const ofVec2f& point) const
+{
+    ofVec2f offset = point - center;
+
+    float distanceSquared = offset.lengthSquared();
+
+    if (distanceSquared > radius * radius)
+    {
+        return false;
+    }
+
+    // Within half the view angle of the middle.
+    return isFull || offset.dot(direction) >= cosHalfAngle * sqrt(distanceSquared);
+}
+
+
+ofRectangle LightSystem2D::getScissorRect(const Light2D& light, const ofFbo& target)
+{
+    ofRectangle box = light.getBoundingBox();
+
+    float minX = std::max(std::floor(box.getMinX()), 0.0f);
+    float minY = std::max(std::floor(box.getMinY()), 0.0f);
+    float maxX = std::min(std::ceil(box.getMaxX()), target.getWidth());
+    float maxY = std::min(std::ceil(box.getMaxY()), target.getHeight());
+
+    if (maxX <= minX || maxY <= minY)
+    {
+        return ofRectangle();
+    }
+
+    return ofRectangle(minX, minY, maxX - minX, maxY - minY);
+}
+
+
+bool LightSystem2D::hasVisibilityPolygons() const
+{
+    return _shadowMode == SHADOW_VISIBILITY || _compositeMode == COMPOSITE_TILED;
+}
+
+
+bool LightSystem2D::isTiled() const
+{
+    return (_compositeMode == COMPOSITE_TILED || _shadowMode == SHADOW_POLAR) &&
+           TiledLights2D::isSupported();
+}
+
+
+void LightSystem2D::updateTiledLights()
+{
+    _profiler.begin(Profiler2D::PHASE_UPLOAD, true);
+
+    _tiledLights.clear();
+
+    Light2D::List::const_iterator lightIter = _lights.begin();
+
+    while (lightIter != _lights.end())
+    {
+        if (!reachesViewport(**lightIter) ||
+            _bakedLights.find(lightIter->get()) != _bakedLights.end())
+        {
+            ++lightIter;
+            continue;
+        }
+
+        if (_shadowMode == SHADOW_POLAR && (*lightIter)->getCastsShadows())
+        {
+            _tiledLights.addOccluded(**lightIter);
+        }
+        else
+        {
+            const float* shadowMap = 0;
+
+            ShadowBatchMap::const_iterator batchIter = _shadowBatches.find(lightIter->get());
+
+            if (batchIter != _shadowBatches.end() && !batchIter->second.shadowMap.empty())
+            {
+                shadowMap = &batchIter->second.shadowMap[0];
+            }
 
-            // Scale the ray by the light's radius.
-            ray *= light->getRadius();
+            _tiledLights.add(**lightIter, shadowMap);
+        }
+
+        ++_stats.numLightsDrawn;
+
+        ++lightIter;
+    }
+
+    _tiledLights.update(_sceneComp.getWidth(), _sceneComp.getHeight());
+
+    _profiler.end(Profiler2D::PHASE_UPLOAD, true);
+
+    if (_shadowMode == SHADOW_POLAR)
+    {
+        _profiler.begin(Profiler2D::PHASE_LIGHT, true);
+
+        drawOccluders();
+        _tiledLights.updateShadowMaps(_occluderComp.getTexture());
+
+        ++_stats.numFboBinds;
+
+        _profiler.end(Profiler2D::PHASE_LIGHT, true);
+    }
+}
+
+
+void LightSystem2D::drawOccluders()
+{
+    if (_occluderComp.getWidth() != _sceneComp.getWidth() ||
+        _occluderComp.getHeight() != _sceneComp.getHeight())
+    {
+        ofFbo::Settings settings;
+        settings.width = _sceneComp.getWidth();
+        settings.height = _sceneComp.getHeight();
+        settings.internalformat = GL_R8;
+        settings.textureTarget = GL_TEXTURE_2D;
+
+        _occluderComp.allocate(settings);
+
+        _areOccludersStale = true;
+    }
+
+    if (!_areOccludersStale)
+    {
+        return;
+    }
+
+    if (!_occluderShader.isLoaded())
+    {
+        _occluderShader.setupShaderFromSource(GL_VERTEX_SHADER, OCCLUDER_VERTEX_SHADER_SRC);
+        _occluderShader.setupShaderFromSource(GL_FRAGMENT_SHADER, OCCLUDER_FRAGMENT_SHADER_SRC);
+        _occluderShader.bindDefaults();
+        _occluderShader.linkProgram();
+    }
+
+    _occluderComp.begin();
+    ofClear(0, 0, 0, 0);
+
+    ++_stats.numFboBinds;
+    ++_stats.numFboClears;
+
+    _occluderShader.begin();
+
+    Shape2D::List::const_iterator shapeIter = _shapes.begin();
+
+    while (shapeIter != _shapes.end())
+    {
+        (*shapeIter)->draw();
+        ++shapeIter;
+    }
+
+    _occluderShader.end();
+
+    _occluderComp.end();
+
+    _areOccludersStale = false;
+}
+
+
+ofRectangle LightSystem2D::getLightmapRect(const ofRectangle& rect) const
+{
+    float minX = std::floor(rect.getMinX() * _lightmapScale);
+    float minY = std::floor(rect.getMinY() * _lightmapScale);
+    float maxX = std::min(std::ceil(rect.getMaxX() * _lightmapScale), _lightComp.getWidth());
+    float maxY = std::min(std::ceil(rect.getMaxY() * _lightmapScale), _lightComp.getHeight());
+
+    return ofRectangle(minX, minY, maxX - minX, maxY - minY);
+}
+
+
+void LightSystem2D::updateDamage()
+{
+    const std::vector<ofRectangle>& shapeDamage = _store.getDamage();
+
+    Light2D::List::const_iterator lightIter = _lights.begin();
+
+    while (lightIter != _lights.end())
+    {
+        const Light2D& light = **lightIter;
+
+        if (reachesViewport(light))
+        {
+            ShadowBatchMap::const_iterator batchIter = _shadowBatches.find(&light);
+
+            std::size_t generation = batchIter != _shadowBatches.end() ? batchIter->second.generation : 0;
+
+            LightState& state = _drawnLights[&light];
+
+            if (!state.isCurrent(light, generation))
+            {
+                addDamage(state.rect);
+                state.set(light, generation, getScissorRect(light, _sceneComp));
+                addDamage(state.rect);
+            }
+            else if (_shadowMode == SHADOW_POLAR && light.getCastsShadows())
+            {
+                // Without batches, any change to a shape in reach may move
+                // the light's shadows.
+                for (std::size_t i = 0; i < shapeDamage.size(); ++i)
+                {
+                    if (shapeDamage[i].intersects(state.rect))
+                    {
+                        addDamage(state.rect);
+                        break;
+                    }
+                }
+            }
+
+            state.frame = _frame;
+        }
+
+        ++lightIter;
+    }
+
+    // Lights that were removed or left the viewport.
+    LightStateMap::iterator stateIter = _drawnLights.begin();
+
+    while (stateIter != _drawnLights.end())
+    {
+        if (stateIter->second.frame != _frame)
+        {
+            addDamage(stateIter->second.rect);
+            _drawnLights.erase(stateIter++);
+        }
+        else
+        {
+            ++stateIter;
+        }
+    }
+
+    for (std::size_t i = 0; i < shapeDamage.size(); ++i)
+    {
+        addDamage(shapeDamage[i]);
+    }
+
+    _store.clearDamage();
+
+    addDamage(_staleRect);
+}
+
+
+void LightSystem2D::addDamage(const ofRectangle& rect)
+{
+    // Whole pixels of the scene.
+    float minX = std::max(std::floor(rect.getMinX()), 0.0f);
+    float minY = std::max(std::floor(rect.getMinY()), 0.0f);
+    float maxX = std::min(std::ceil(rect.getMaxX()), _sceneComp.getWidth());
+    float maxY = std::min(std::ceil(rect.getMaxY()), _sceneComp.getHeight());
+
+    if (maxX <= minX || maxY <= minY)
+    {
+        return;
+    }
+
+    ofRectangle damage(minX, minY, maxX - minX, maxY - minY);
+
+    std::size_t nearest = 0;
+    float nearestGrowth = std::numeric_limits<float>::max();
+
+    for (std::size_t i = 0; i < _damage.size(); ++i)
+    {
+        ofRectangle merged = _damage[i];
+        merged.growToInclude(damage);
+
+        float growth = merged.getArea() - _damage[i].getArea();
+
+        if (growth < nearestGrowth)
+        {
+            nearest = i;
+            nearestGrowth = growth;
+        }
+    }
+
+    if (!_damage.empty() && nearestGrowth <= 0)
+    {
+        // Already covered.
+        return;
+    }
+
+    // Drop the rectangles that the new one covers.
+    std::size_t numKept = 0;
+
+    for (std::size_t i = 0; i < _damage.size(); ++i)
+    {
+        if (_damage[i].getMinX() < minX ||
+            _damage[i].getMinY() < minY ||
+            _damage[i].getMaxX() > maxX ||
+            _damage[i].getMaxY() > maxY)
+        {
+            _damage[numKept++] = _damage[i];
+        }
+    }
+
+    if (numKept < _damage.size())
+    {
+        nearest = 0;
+        _damage.resize(numKept);
+    }
+
+    if (_damage.size() < MAX_DAMAGE_RECTS)
+    {
+        _damage.push_back(damage);
+    }
+    else
+    {
+        _damage[nearest].growToInclude(damage);
+    }
+}
+
+
+bool LightSystem2D::LightState::isCurrent(const Light2D& light, std::size_t batchGeneration) const
+{
+    return frame > 0 &&
+           lightVersion == light.getVersion() &&
+           generation == batchGeneration &&
+           color == light.getColor() &&
+           bleed == light.getBleed() &&
+           linearizeFactor == light.getLinearizeFactor() &&
+           castsShadows == light.getCastsShadows();
+}
+
+
+void LightSystem2D::LightState::set(const Light2D& light,
+                                    std::size_t batchGeneration,
+                                    const ofRectangle& lightRect)
+{
+    rect = lightRect;
+    lightVersion = light.getVersion();
+    generation = batchGeneration;
+    color = light.getColor();
+    bleed = light.getBleed();
+    linearizeFactor = light.getLinearizeFactor();
+    castsShadows = light.getCastsShadows();
+}
+
+
+void LightSystem2D::updateStaticLayer()
+{
+    Light2D::List::const_iterator lightIter = _lights.begin();
+
+    while (lightIter != _lights.end())
+    {
+        const Light2D& light = **lightIter;
+
+        ShadowBatchMap::const_iterator batchIter = _shadowBatches.find(&light);
+
+        bool hasBatch = batchIter != _shadowBatches.end();
+
+        // A dynamic shape in reach takes the light out of the layer until
+        // it leaves again.  Polar shadows have no batches to tell, and are
+        // never baked.
+        if (light.isStatic() &&
+            _shadowMode != SHADOW_POLAR &&
+            reachesViewport(light) &&
+            (!hasBatch || batchIter->second.numDynamicShapes == 0))
+        {
+            std::size_t generation = hasBatch ? batchIter->second.generation : 0;
+
+            LightState& baked = _bakedLights[&light];
+
+            if (!baked.isCurrent(light, generation))
+            {
+                // Both where the light was and where it is now.
+                invalidateStaticLayer(baked.rect);
+                baked.set(light, generation, getScissorRect(light, _sceneComp));
+                invalidateStaticLayer(baked.rect);
+            }
+
+            baked.frame = _frame;
+
+            ++_stats.numLightsBaked;
+        }
+
+        ++lightIter;
+    }
+
+    // Lights that were removed, or can no longer be baked.
+    LightStateMap::iterator bakedIter = _bakedLights.begin();
+
+    while (bakedIter != _bakedLights.end())
+    {
+        if (bakedIter->second.frame != _frame)
+        {
+            invalidateStaticLayer(bakedIter->second.rect);
+            _bakedLights.erase(bakedIter++);
+        }
+        else
+        {
+            ++bakedIter;
+        }
+    }
+}
+
+
+void LightSystem2D::drawStaticLayer()
+{
+    if (_staleRect.isEmpty())
+    {
+        return;
+    }
 
-            // Offset the ray to the boundary point.
-            ray += boundaryPoint;
+    if (_staticComp.getWidth() != _sceneComp.getWidth() ||
+        _staticComp.getHeight() != _sceneComp.getHeight())
+    {
+        ofFbo::Settings settings;
+        settings.width = _sceneComp.getWidth();
+        settings.height = _sceneComp.getHeight();
+        settings.internalformat = GL_RGBA;
+        settings.useStencil = true;
+
+        _staticComp.allocate(settings);
+    }
+
+    ofRectangle staleRect = _staleRect;
+
+    _staleRect = ofRectangle();
+
+    _staticComp.begin();
+    beginScissor(staleRect, _staticComp);
+    ofClear(0, 0, 0, 0);
+    endScissor();
+
+    ++_stats.numFboBinds;
+    ++_stats.numFboClears;
+
+    bool isDirect = _compositeMode == COMPOSITE_STENCIL ||
+                    hasVisibilityPolygons();
+
+    if (!isDirect)
+    {
+        _staticComp.end();
+    }
+
+    // Each light is clipped to the stale part, so the scissor is needed
+    // even when it is otherwise off.
+    bool isScissorEnabled = _isScissorEnabled;
+
+    _isScissorEnabled = true;
+
+    Light2D::List::const_iterator lightIter = _lights.begin();
 
-            mask.addVertex(boundaryPoint);
-            mask.addColor(ofFloatColor::black);
-            mask.addVertex(ray);
-            mask.addColor(ofFloatColor::black);
+    while (lightIter != _lights.end())
+    {
+        LightStateMap::const_iterator bakedIter = _bakedLights.find(lightIter->get());
+
+        ofRectangle rect;
+
+        if (bakedIter != _bakedLights.end())
+        {
+            rect = bakedIter->second.rect.getIntersection(staleRect);
+        }
+
+        if (rect.isEmpty())
+        {
+            ++lightIter;
+            continue;
+        }
+
+        ShadowBatch* batch = 0;
+
+        ShadowBatchMap::iterator batchIter = _shadowBatches.find(lightIter->get());
+
+        if (batchIter != _shadowBatches.end())
+        {
+            batch = &batchIter->second;
+            uploadBatch(*batch);
+        }
+
+        if (hasVisibilityPolygons())
+        {
+            drawLightVisibility(**lightIter, batch, rect);
         }
+        else if (_compositeMode == COMPOSITE_STENCIL)
+        {
+            drawLightStencil(**lightIter, batch, rect);
+        }
+        else
+        {
+            drawLightFbo(**lightIter, batch, rect, _staticComp);
+        }
+
+        ++_stats.numLightsRebaked;
+
+        ++lightIter;
+    }
+
+    _isScissorEnabled = isScissorEnabled;
+
+    if (isDirect)
+    {
+        _staticComp.end();
+    }
+}
+
+
+void LightSystem2D::invalidateStaticLayer(const ofRectangle& rect)
+{
+    if (rect.isEmpty())
+    {
+        return;
+    }
+
+    if (_staleRect.isEmpty())
+    {
+        _staleRect = rect;
+    }
+    else
+    {
+        _staleRect.growToInclude(rect);
+    }
+}
+
+
+void LightSystem2D::invalidateStaticLayer()
+{
+    invalidateStaticLayer(ofRectangle(0, 0, _sceneComp.getWidth(), _sceneComp.getHeight()));
+}
+
+
+void LightSystem2D::beginScissor(const ofRectangle& rect, const ofFbo& target)
+{
+    // The scissor box is in GL window coordinates, which start at the
+    // bottom unless the renderer flips them to match screen coordinates.
+    GLint y = ofIsVFlipped() ? target.getHeight() - rect.getMaxY() : rect.y;
+
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(rect.x, y, rect.width, rect.height);
+}
+
+
+void LightSystem2D::endScissor()
+{
+    glDisable(GL_SCISSOR_TEST);
+}
+
+
+std::size_t LightSystem2D::getMemorySize(const ofMesh& mesh)
+{
+    return mesh.getNumVertices() * sizeof(ofVec3f) +
+           mesh.getNumColors() * sizeof(ofFloatColor) +
+           mesh.getNumIndices() * sizeof(ofIndexType);
+}
+
+
+LightSystem2D::Stats LightSystem2D::combine(const Stats& a,
+                                            const Stats& b,
+                                            const std::function<double(double, double)>& op)
+{
+    Stats result;
+    result.numLights = op(a.numLights, b.numLights);
+    result.numShapes = op(a.numShapes, b.numShapes);
+    result.numPairs = op(a.numPairs, b.numPairs);
+    result.numPairsCulled = op(a.numPairsCulled, b.numPairsCulled);
+    result.numPairsSkipped = op(a.numPairsSkipped, b.numPairsSkipped);
+    result.numLightsCulled = op(a.numLightsCulled, b.numLightsCulled);
+    result.numShadowsRebuilt = op(a.numShadowsRebuilt, b.numShadowsRebuilt);
+    result.shadowMemory = op(a.shadowMemory, b.shadowMemory);
+    result.numUpdateAllocations = op(a.numUpdateAllocations, b.numUpdateAllocations);
+    result.numDrawAllocations = op(a.numDrawAllocations, b.numDrawAllocations);
+    result.numShapesTested = op(a.numShapesTested, b.numShapesTested);
+    result.numLightsDrawn = op(a.numLightsDrawn, b.numLightsDrawn);
+    result.numLightsBaked = op(a.numLightsBaked, b.numLightsBaked);
+    result.numLightsRebaked = op(a.numLightsRebaked, b.numLightsRebaked);
+    result.numShadowQuads = op(a.numShadowQuads, b.numShadowQuads);
+    result.numVerticesUploaded = op(a.numVerticesUploaded, b.numVerticesUploaded);
+    result.numBytesUploaded = op(a.numBytesUploaded, b.numBytesUploaded);
+    result.numFboClears = op(a.numFboClears, b.numFboClears);
+    result.numFboBinds = op(a.numFboBinds, b.numFboBinds);
+    result.numDamageRects = op(a.numDamageRects, b.numDamageRects);
+    result.numDamagePixels = op(a.numDamagePixels, b.numDamagePixels);
+    result.maskTime = op(a.maskTime, b.maskTime);
+    result.uploadTime = op(a.uploadTime, b.uploadTime);
+    result.lightTime = op(a.lightTime, b.lightTime);
+    result.compositeTime = op(a.compositeTime, b.compositeTime);
+    result.gpuUploadTime = op(a.gpuUploadTime, b.gpuUploadTime);
+    result.gpuLightTime = op(a.gpuLightTime, b.gpuLightTime);
+    result.gpuCompositeTime = op(a.gpuCompositeTime, b.gpuCompositeTime);
+    return result;
+}
+
+
+float LightSystem2D::getTransmittance(const ofVec2f& point,
+                                     const ofMesh& mask,
+                                     std::size_t firstIndex)
+{
+    if (!mask.hasTexCoords())
+    {
+        return 0;
+    }
+
+    const std::vector<ofVec3f>& vertices = mask.getVertices();
+    const std::vector<ofVec2f>& texCoords = mask.getTexCoords();
+    const std::vector<ofIndexType>& indices = mask.getIndices();
+
+    ofIndexType i0 = indices[firstIndex];
+    ofIndexType i1 = indices[firstIndex + 1];
+    ofIndexType i2 = indices[firstIndex + 2];
+
+    const ofVec3f& a = vertices[i0];
+    const ofVec3f& b = vertices[i1];
+    const ofVec3f& c = vertices[i2];
+
+    // Barycentric weights from the signed areas opposite each vertex.
+    float weightA = (c.x - b.x) * (point.y - b.y) - (c.y - b.y) * (point.x - b.x);
+    float weightB = (a.x - c.x) * (point.y - c.y) - (a.y - c.y) * (point.x - c.x);
+    float weightC = (b.x - a.x) * (point.y - a.y) - (b.y - a.y) * (point.x - a.x);
+
+    float area = weightA + weightB + weightC;
+
+    if (area == 0)
+    {
+        return 0;
     }
+
+    ofVec2f texCoord = (texCoords[i0] * weightA + texCoords[i1] * weightB + texCoords[i2] * weightC) / area;
+
+    return Light2D::getPenumbra(texCoord);
+}
+
+
+bool LightSystem2D::isInside(const ofVec2f& point,
+                             const ofVec3f& a,
+                             const ofVec3f& b,
+                             const ofVec3f& c)
+{
+    // The point is inside when it lies on the same side of all three edges,
+    // for either winding.  Points on an edge count as inside.
+    float ab = (b.x - a.x) * (point.y - a.y) - (b.y - a.y) * (point.x - a.x);
+    float bc = (c.x - b.x) * (point.y - b.y) - (c.y - b.y) * (point.x - b.x);
+    float ca = (a.x - c.x) * (point.y - c.y) - (a.y - c.y) * (point.x - c.x);
+
+    return (ab >= 0 && bc >= 0 && ca >= 0) || (ab <= 0 && bc <= 0 && ca <= 0);
 }
 
 
 void LightSystem2D::windowResized(ofResizeEventArgs& resize)
 {
-    _lightComp.allocate(resize.width, resize.height, GL_RGBA);
-    _sceneComp.allocate(resize.width, resize.height, GL_RGBA);
+    _lightComp.allocate(std::ceil(resize.width * _lightmapScale),
+                        std::ceil(resize.height * _lightmapScale),
+                        GL_RGBA);
+
+    // The stencil is only used by COMPOSITE_STENCIL, but is cheap to keep.
+    ofFbo::Settings settings;
+    settings.width = resize.width;
+    settings.height = resize.height;
+    settings.internalformat = GL_RGBA;
+    settings.useStencil = true;
+
+    _sceneComp.allocate(settings);
+
+    // The static layer is reallocated to match when it is next drawn.
+    invalidateStaticLayer();
+    invalidate();
 }
 
 
@@ -26,11 +26,23 @@
 #pragma once
 
 
+#include <functional>
 #include "Light2D.h"
+#include "LightBatch2D.h"
+#include "Profiler2D.h"
+#include "SceneStore2D.h"
 #include "Shape2D.h"
+#include "ShapeGrid2D.h"
+#include "Silhouette2D.h"
+#include "SoftwareRenderer2D.h"
+#include "TiledLights2D.h"
+#include "Visibility2D.h"
+#include "WorkerPool.h"
+#include "ofPixels.h"
 #include "ofTexture.h"
 #include "ofShader.h"
 #include "ofFbo.h"
+#include "ofVbo.h"
 
 
 namespace ofx {
@@ -39,6 +51,130 @@ namespace ofx {
 class LightSystem2D
 {
 public:
+    struct Stats
+    {
+        std::size_t numLights;
+        std::size_t numShapes;
+
+        // Every light / shape combination.
+        std::size_t numPairs;
+
+        // Pairs rejected by the spatial index, the radius or spot light
+        // wedge test, or because the light does not reach the viewport.
+        std::size_t numPairsCulled;
+
+        // Pairs of lights in view that build no shadows, because they cast
+        // none or because SHADOW_POLAR finds them on the GPU.  Neither
+        // culled nor visible.
+        std::size_t numPairsSkipped;
+
+        // Lights that do not reach the viewport.
+        std::size_t numLightsCulled;
+
+        // Shadow masks rebuilt because the light or shape changed.
+        std::size_t numShadowsRebuilt;
+
+        // Bytes held by cached shadow masks and batches.
+        std::size_t shadowMemory;
+
+        // Heap allocations made by update() and draw(), if
+        // AllocationCounter2D is enabled.  Zero in steady state.
+        std::size_t numUpdateAllocations;
+        std::size_t numDrawAllocations;
+
+        // Shapes returned by the spatial index before the radius test.
+        std::size_t numShapesTested;
+
+        std::size_t numLightsDrawn;
+
+        // Static lights served from the baked layer, and those drawn into
+        // it again because they, or what is in their reach, changed.
+        std::size_t numLightsBaked;
+        std::size_t numLightsRebaked;
+
+        // The rectangles of the scene composited again, and their area in
+        // pixels.  Zero when nothing changed.
+        std::size_t numDamageRects;
+        std::size_t numDamagePixels;
+
+        // Shadow quads (two triangles per silhouette edge) submitted.
+        std::size_t numShadowQuads;
+
+        std::size_t numVerticesUploaded;
+        std::size_t numBytesUploaded;
+        std::size_t numFboClears;
+        std::size_t numFboBinds;
+
+        // CPU time of each phase in microseconds.  The draw phases measure
+        // submission, not GPU execution.
+        uint64_t maskTime;
+        uint64_t uploadTime;
+        uint64_t lightTime;
+        uint64_t compositeTime;
+
+        // GPU time of each draw phase in microseconds, from timer queries a
+        // few frames old, or -1 when GPU timing is off or unsupported.
+        int64_t gpuUploadTime;
+        int64_t gpuLightTime;
+        int64_t gpuCompositeTime;
+    };
+
+    enum CompositeMode
+    {
+        // Draw each light and its shadows into an intermediate buffer,
+        // then add that buffer to the scene.
+        COMPOSITE_FBO,
+
+        // Mark each light's shadows in the stencil buffer and add the light
+        // directly to the scene where the stencil is clear.  This avoids the
+        // intermediate buffer and its per-light bind and blit.
+        COMPOSITE_STENCIL,
+
+        // Bin the lights into screen tiles and add them all to the scene in
+        // one pass, each fragment evaluating only the lights of its tile.
+        // Shadows are sampled from a polar shadow map per light, built from
+        // its visibility polygon unless SHADOW_POLAR finds it on the GPU,
+        // and are hard.
+        // Needs the programmable renderer; otherwise each light is drawn
+        // into its visibility polygon.  Like instancing, this does not
+        // call Light2D::draw().
+        COMPOSITE_TILED
+    };
+
+    enum ShadowMode
+    {
+        // Extrude a shadow mask from every shape and cut it out of the
+        // light.
+        SHADOW_MASKS,
+
+        // Sweep every shape's edges around the light to find the one
+        // polygon it can see, and draw the light into that polygon only.
+        // This draws no masks, so its cost does not grow with overlapping
+        // shadows.  Lights are added directly to the scene, so the
+        // composite mode and the lightmap scale do not apply.
+        SHADOW_VISIBILITY,
+
+        // Draw every shape once into an occluder buffer, and find the
+        // nearest occluder in each direction around every light on the
+        // GPU, into one row per light of a shared polar shadow atlas.  No
+        // shadow geometry is built on the CPU, so the cost hardly depends
+        // on the number of shapes or overlapping shadows.  Lights are added
+        // with the tiled pass of COMPOSITE_TILED whatever the composite
+        // mode, and are not baked.  Only shapes inside the window occlude,
+        // and evaluate() and render() see no shadows.  Needs the
+        // programmable renderer; otherwise lights cast no shadows.
+        SHADOW_POLAR
+    };
+
+    // Stats over the last frames of the rolling window.
+    struct StatsSummary
+    {
+        std::size_t numFrames;
+        Stats mean;
+        Stats min;
+        Stats max;
+    };
+
     LightSystem2D();
     virtual ~LightSystem2D();
 
@@ -61,19 +197,539 @@ public:
     void clearLights();
     void clearShapes();
 
+    // The number of threads used to build shadow geometry, including the
+    // update thread.  One selects the serial path, zero the hardware
+    // concurrency.
+    void setNumThreads(std::size_t numThreads);
+    std::size_t getNumThreads() const;
+
+    void setGridCellSize(float cellSize);
+    float getGridCellSize() const;
+
+    void setCompositeMode(CompositeMode mode);
+    CompositeMode getCompositeMode() const;
+
+    // SHADOW_MASKS by default.  Changing the mode rebuilds all shadows.
+    void setShadowMode(ShadowMode mode);
+    ShadowMode getShadowMode() const;
+
+    // The resolution of the light accumulation buffer relative to the
+    // window, e.g. 0.5 or 0.25.  Shadows are still applied at full
+    // resolution.  Only COMPOSITE_FBO uses the lightmap.  Below 1, lights
+    // are drawn with Light2D::draw(float).
+    void setLightmapScale(float scale);
+    float getLightmapScale() const;
+
+    // Draw every light without shadows in one instanced call, directly into
+    // the scene.  Needs the programmable renderer.  Lights that override
+    // Light2D::draw() should disable this.  Enabled by default.
+    void setInstancingEnabled(bool enabled);
+    bool isInstancingEnabled() const;
+
+    // Upload shadow masks as 2D positions only (8 bytes per vertex) rather
+    // than 3D positions with colors (28 bytes per vertex).  Enabled by
+    // default.
+    void setCompactVerticesEnabled(bool enabled);
+    bool isCompactVerticesEnabled() const;
+
+    // Restrict the clear, light, masks and composite of every light to its
+    // bounding rectangle.  Enabled by default.
+    void setScissorEnabled(bool enabled);
+    bool isScissorEnabled() const;
+
+    // Composite only the parts of the scene that changed since the last
+    // frame, and nothing when none did.  A light whose drawing changes
+    // without a change to its properties, e.g. through its own shader,
+    // needs invalidate().  Enabled by default.
+    void setDamageTrackingEnabled(bool enabled);
+    bool isDamageTrackingEnabled() const;
+
+    // Composite the whole scene again in the next draw().
+    void invalidate();
+
+    // Lights that do not reach the viewport are not built, drawn or
+    // evaluated.  An empty rectangle, the default, uses the window, or
+    // disables the test before setup().
+    void setViewport(const ofRectangle& viewport);
+    const ofRectangle& getViewport() const;
+
+    const Stats& getStats() const;
+
+    // The number of completed frames kept for getStatsSummary().
+    void setStatsWindowSize(std::size_t numFrames);
+    std::size_t getStatsWindowSize() const;
+
+    StatsSummary getStatsSummary() const;
+
+    // GPU timing uses timer queries and is off by default.
+    void setGpuTimingEnabled(bool enabled);
+    bool isGpuTimingEnabled() const;
+
+    // Record every phase as a Chrome trace event.  Load the saved file in
+    // chrome://tracing or https://ui.perfetto.dev.
+    void setTracing(bool tracing);
+    bool isTracing() const;
+    bool saveTrace(const std::string& path) const;
+    void clearTrace();
+
+    static const std::size_t DEFAULT_STATS_WINDOW_SIZE;
+
+    // Evaluate the composited light intensity on the CPU, using the same
+    // attenuation as the light shader and the shadow geometry built by the
+    // last update().  Needs no GL context.
+    ofFloatColor evaluate(const ofVec2f& point) const;
+
+    // Evaluate at the center of every pixel of a grid spanning the region.
+    // The pixels must be allocated; their size sets the grid resolution.
+    void evaluate(const ofRectangle& region, ofFloatPixels& pixels) const;
+
+    // Render the lighting composite with the multithreaded software
+    // rasterizer instead of the GPU.  Like evaluate(), this uses the
+    // geometry from the last update() and samples pixel centers.
+    void render(const ofRectangle& region, ofFloatPixels& pixels);
+
     void windowResized(ofResizeEventArgs& resize);
 
 protected:
+    // The area a light reaches: its circle, cut to a wedge for a spot
+    // light.
+    struct Wedge
+    {
+        Wedge(float x, float y, float radius, float angle, float viewAngle);
+
+        bool isInside(const ofVec2f& point) const;
+
+        ofVec2f center;
+        float radius;
+
+        // The middle of the wedge and its two sides, as unit vectors, and
+        // the cosine of half the view angle.
+        ofVec2f direction;
+        ofVec2f start;
+        ofVec2f end;
+        float cosHalfAngle;
+
+        bool isFull;
+    };
+
+    // A cached shadow mask and its range in a batch mesh.
+    struct Shadow
+    {
+        const Shape2D* shape;
+        std::size_t lightVersion;
+        std::size_t shapeVersion;
+        std::size_t firstVertex;
+        std::size_t numVertices;
+        std::size_t firstIndex;
+        std::size_t numIndices;
+    };
+
+    typedef std::vector<Shadow> ShadowList;
+
+    enum
+    {
+        // Upload buffers per batch, so that an upload never waits for the
+        // GPU to finish drawing from the previous frame's buffer.
+        NUM_UPLOAD_BUFFERS = 3,
+
+        // Damage beyond this many rectangles is merged into the nearest.
+        MAX_DAMAGE_RECTS = 8
+    };
+
+    // A persistent GPU buffer that grows but is otherwise updated in place.
+    struct UploadBuffer
+    {
+        ofVbo vbo;
+        std::size_t vertexCapacity;
+        std::size_t indexCapacity;
+        std::size_t numIndices;
+        bool isCompact;
+        bool hasTexCoords;
+    };
+
+    // All shadow masks of one light, merged into a single indexed triangle
+    // mesh so that they can be submitted with one draw call.
+    //
+    // The masks are built straight into one of two meshes that serve as
+    // arenas: a changed frame is rebuilt into the other one, copying the
+    // unchanged masks from the current one, and the two are then flipped.
+    // All buffers keep their capacity, so steady-state frames do not
+    // allocate.
+    //
+    // Batches are built on the worker pool during update() and only touched
+    // by the draw thread for upload and submission.
+    struct ShadowBatch
+    {
+        Light2D::SharedPtr light;
+
+        // The light's index in the scene store.
+        std::size_t lightIndex;
+
+        std::vector<const Shape2D*> candidates;
+
+        // Scene store indices of the shapes in the light's radius.
+        std::vector<uint32_t> visibleShapes;
+
+        // The masks of the visible shapes, in order, and their geometry.
+        ShadowList shadows[2];
+        ofMesh meshes[2];
+        std::size_t current;
+
+        // Scratch space for buildBatch() and makeMask().
+        std::vector<uint32_t> sortedShadows;
+        std::vector<Silhouette2D::Word> backFacing;
+        std::vector<Silhouette2D::Run> runs;
+
+        // With SHADOW_VISIBILITY the mesh holds the light's visibility
+        // polygon instead of its masks, and the shadows have no geometry.
+        Visibility2D visibility;
+
+        // With COMPOSITE_TILED, the visibility polygon sampled into
+        // TiledLights2D::SHADOW_MAP_SIZE directions, or empty if nothing
+        // occludes the light.
+        std::vector<float> shadowMap;
+
+        // Upload staging in the compact and the full vertex format.
+        std::vector<ofVec2f> compactVertices;
+        std::vector<ofFloatColor> colors;
+
+        UploadBuffer uploadBuffers[NUM_UPLOAD_BUFFERS];
+        std::size_t currentUploadBuffer;
+
+        bool isDirty;
+        bool needsUpload;
+
+        // Incremented whenever the masks are rebuilt.
+        std::size_t generation;
+
+        // Visible shapes that are not static.
+        std::size_t numDynamicShapes;
+
+        std::size_t numShapesTested;
+        std::size_t numPairsVisible;
+        std::size_t numShadowsRebuilt;
+        std::size_t memory;
+
+        const ofMesh& getMesh() const
+        {
+            return meshes[current];
+        }
+    };
+
+    typedef std::map<const Light2D*, ShadowBatch> ShadowBatchMap;
+
+    // A light as it was last drawn into the scene or the static layer.
+    struct LightState
+    {
+        // The light's part of the target.
+        ofRectangle rect;
+
+        std::size_t lightVersion;
+        std::size_t generation;
+        ofFloatColor color;
+        float bleed;
+        float linearizeFactor;
+
+        // Polar shadows have no batch, so a light that starts or stops
+        // casting them changes no generation.
+        bool castsShadows;
+
+        // The last frame in which the light was drawn or could be baked.
+        std::size_t frame;
+
+        // Whether the light and its batch generation match the state.
+        bool isCurrent(const Light2D& light, std::size_t batchGeneration) const;
+
+        void set(const Light2D& light,
+                 std::size_t batchGeneration,
+                 const ofRectangle& lightRect);
+    };
+
+    typedef std::map<const Light2D*, LightState> LightStateMap;
+
+    void buildBatch(ShadowBatch& batch) const;
+
+    // Whether the visible shapes or their shadows differ from the batch's
+    // current masks.
+    bool isChanged(const ShadowBatch& batch) const;
+
+    // Rebuild the batch into its other mesh, reusing unchanged masks.
+    void rebuildBatch(ShadowBatch& batch) const;
+
+    // Replace the batch's polygon with the light's visibility polygon.
+    void rebuildVisibility(ShadowBatch& batch) const;
+
+    void uploadBatch(ShadowBatch& batch);
+
+    // Draw the batch's masks black, or with the penumbra shader if they
+    // have fins.  Binary masks cover only the pixels that get less than
+    // half the light, for the stencil.
+    void drawShadows(const ShadowBatch& batch, bool isBinary);
+
+    // Add the light to the target through the lightmap.
+    void drawLightFbo(Light2D& light,
+                      const ShadowBatch* batch,
+                      const ofRectangle& rect,
+                      ofFbo& target);
+
+    void drawLightStencil(Light2D& light,
+                          const ShadowBatch* batch,
+                          const ofRectangle& rect);
+
+    // Add the light to the scene inside its visibility polygon.
+    void drawLightVisibility(Light2D& light,
+                             const ShadowBatch* batch,
+                             const ofRectangle& rect);
+
+    // Mark the batch's shadows in the stencil buffer and limit drawing to
+    // the unshadowed pixels until endShadowStencil().  Returns false, with
+    // no state changed, if there are no shadows.
+    bool beginShadowStencil(const ShadowBatch* batch);
+    void endShadowStencil();
+
+    // Whether batches hold visibility polygons rather than shadow masks.
+    bool hasVisibilityPolygons() const;
+
+    // Whether lights are added with the tiled pass.
+    bool isTiled() const;
+
+    // Draw every shape into the occluder buffer again if any changed.
+    void drawOccluders();
+
+    // Add every light that is not baked to the tiled lights, with its
+    // shadow map, and upload them.
+    void updateTiledLights();
+
+    // A rectangle of the scene in whole lightmap pixels.
+    ofRectangle getLightmapRect(const ofRectangle& rect) const;
+
+    // Find the static lights that only have static shapes in their reach,
+    // and mark the parts of the static layer whose lights changed as stale.
+    void updateStaticLayer();
+
+    // Draw the baked lights again into the stale part of the static layer.
+    void drawStaticLayer();
+
+    // Mark the parts of the scene under changed lights and shapes, and
+    // under the stale part of the static layer, as damaged.
+    void updateDamage();
+
+    // Add a rectangle to the damage, merging it into the rectangle it
+    // grows least once there are MAX_DAMAGE_RECTS.
+    void addDamage(const ofRectangle& rect);
+
+    // Clear the region of the scene and composite it again.
+    void drawScene(const ofRectangle& region);
+
+    // Mark a part of the static layer, or all of it, as stale.
+    void invalidateStaticLayer(const ofRectangle& rect);
+    void invalidateStaticLayer();
+
     Light2D::List _lights;
     Shape2D::List _shapes;
 
+    ShapeGrid2D _shapeGrid;
+
+    SceneStore2D _store;
+
+    ShadowBatchMap _shadowBatches;
+
+    std::vector<ShadowBatch*> _batchQueue;
+
+    WorkerPool _workers;
+
+    SoftwareRenderer2D _softwareRenderer;
+
+    std::size_t _frame;
+
+    CompositeMode _compositeMode;
+
+    ShadowMode _shadowMode;
+
+    float _lightmapScale;
+
+    bool _isInstancingEnabled;
+
+    bool _isCompactVerticesEnabled;
+
+    LightBatch2D _lightBatch;
+
+    TiledLights2D _tiledLights;
+
+    bool _isScissorEnabled;
+
+    ofRectangle _viewport;
+
+    bool _isDamageTrackingEnabled;
+
+    // The lights composited into the scene by the last draw(), and the
+    // parts of the scene to composite again in the next.
+    LightStateMap _drawnLights;
+    std::vector<ofRectangle> _damage;
+
+    Stats _stats;
+
+    // A ring of the last completed frames.
+    std::vector<Stats> _statsHistory;
+    std::size_t _statsHistoryIndex;
+
+    uint64_t _allocationCount;
+
+    std::size_t _statsWindowSize;
+
+    Profiler2D _profiler;
+
     ofFbo _lightComp;
     ofFbo _sceneComp;
 
-    static void makeMask(Light2D::SharedPtr light,
-                         Shape2D::SharedPtr shape,
+    // The light of the baked static lights, added to the scene each frame.
+    ofFbo _staticComp;
+    LightStateMap _bakedLights;
+    ofRectangle _staleRect;
+
+    // The shapes, covering the pixels they occlude, for SHADOW_POLAR.
+    ofFbo _occluderComp;
+    bool _areOccludersStale;
+    ofShader _occluderShader;
+
+    ofShader _penumbraShader;
+
+    void setupPenumbraShader();
+
+    // The penumbra shader for the programmable renderer, and its fragment
+    // shader for the fixed function pipeline.
+    static const std::string PENUMBRA_VERTEX_SHADER_SRC;
+    static const std::string PENUMBRA_FRAGMENT_SHADER_SRC;
+    static const std::string PENUMBRA_FIXED_FRAGMENT_SHADER_SRC;
+
+    static const std::string OCCLUDER_VERTEX_SHADER_SRC;
+    static const std::string OCCLUDER_FRAGMENT_SHADER_SRC;
+
+    // Append the shadow of the shape whose loops, with the given numbers of
+    // vertices, start at first in the store to the mask.  A source radius
+    // above zero adds texture coordinates and penumbra fins; see
+    // Light2D::getPenumbra().
+    static void makeMask(float lightX,
+                         float lightY,
+                         float radius,
+                         float sourceRadius,
+                         const SceneStore2D::Vertices& vertices,
+                         std::size_t first,
+                         const uint32_t* loops,
+                         std::size_t numLoops,
+                         std::vector<Silhouette2D::Word>& backFacing,
+                         std::vector<Silhouette2D::Run>& runs,
                          ofMesh& mask);
 
+    // Whether the point is inside the shape whose loops start at first in
+    // the store, by the even-odd rule.
+    static bool isInsideShape(float x,
+                              float y,
+                              const SceneStore2D::Vertices& vertices,
+                              std::size_t first,
+                              const uint32_t* loops,
+                              std::size_t numLoops);
+
+    // Append the shadow of one run of the loop [first, first + count) to the
+    // mask.  A run around the whole loop is extruded as a ring.
+    static void extrudeRun(float lightX,
+                           float lightY,
+                           float radius,
+                           float sourceRadius,
+                           const SceneStore2D::Vertices& vertices,
+                           std::size_t first,
+                           std::size_t count,
+                           const Silhouette2D::Run& run,
+                           ofMesh& mask);
+
+    // Clip the segment from a to b to the circle of the reach around the
+    // light, as fractions of the way from a.  False if none of it is inside.
+    static bool clip(const ofVec2f& light,
+                     float reach,
+                     const ofVec2f& a,
+                     const ofVec2f& b,
+                     float& from,
+                     float& to);
+
+    // Where the ray from a point inside the circle of the reach leaves it.
+    static ofVec2f getFarPoint(const ofVec2f& light,
+                               float reach,
+                               const ofVec2f& point,
+                               const ofVec2f& ray);
+
+    // Append a silhouette point and its far point.  Returns the index of
+    // the silhouette point; the far point follows it.
+    static ofIndexType extrude(const ofVec2f& light,
+                               float reach,
+                               const ofVec2f& point,
+                               const ofVec2f& ray,
+                               bool hasTexCoords,
+                               ofMesh& mask);
+
+    // Close the shadow between two far points on the circle with the arc
+    // between them, where their chord would cut into the circle.
+    static void addFarCap(const ofVec2f& light,
+                          float step,
+                          ofIndexType firstIndex,
+                          ofIndexType lastIndex,
+                          bool hasTexCoords,
+                          ofMesh& mask);
+
+    // Append a shadow's geometry from one mesh to another.
+    static void copyShadow(const Shadow& shadow,
+                           const ofMesh& source,
+                           ofMesh& target);
+
+    // Whether the light's circle touches the rectangle.
+    static bool intersects(float lightX,
+                           float lightY,
+                           float radius,
+                           float minX,
+                           float minY,
+                           float maxX,
+                           float maxY);
+
+    // Whether the closed polygon touches the wedge.  Exact, so only shapes
+    // whose bounds straddle the wedge need their outline tested.
+    static bool intersects(const Wedge& wedge,
+                           const float* x,
+                           const float* y,
+                           std::size_t count);
+
+    // Whether the segments from a to b and from c to d touch.
+    static bool intersects(const ofVec2f& a,
+                           const ofVec2f& b,
+                           const ofVec2f& c,
+                           const ofVec2f& d);
+
+    // Whether the light's circle touches the viewport, or the window if no
+    // viewport is set.  True when neither is known.
+    bool reachesViewport(const Light2D& light) const;
+
+    // The light's bounding box in whole pixels, clipped to the target.
+    static ofRectangle getScissorRect(const Light2D& light, const ofFbo& target);
+
+    static void beginScissor(const ofRectangle& rect, const ofFbo& target);
+    static void endScissor();
+
+    static std::size_t getMemorySize(const ofMesh& mesh);
+
+    // Per-field combination of two stats, used for the summary.
+    static Stats combine(const Stats& a,
+                         const Stats& b,
+                         const std::function<double(double, double)>& op);
+
+    // The light that passes the mask triangle starting at the index, at a
+    // point inside it.
+    static float getTransmittance(const ofVec2f& point,
+                                  const ofMesh& mask,
+                                  std::size_t firstIndex);
+
+    static bool isInside(const ofVec2f& point,
+                         const ofVec3f& a,
+                         const ofVec3f& b,
+                         const ofVec3f& c);
+
 };
 
 
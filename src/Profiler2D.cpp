@@ -0,0 +1,329 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "Profiler2D.h"
+#include <fstream>
+#include "ofGLUtils.h"
+#include "ofLog.h"
+#include "ofUtils.h"
+
+
+namespace ofx {
+
+
+const std::size_t Profiler2D::MAX_TRACE_EVENTS = 1000000;
+
+
+Profiler2D::Profiler2D():
+    _isGpuTimingEnabled(false),
+    _isTracing(false),
+    _gpuFrameIndex(0)
+{
+    for (std::size_t i = 0; i < NUM_PHASES; ++i)
+    {
+        _cpuTimes[i] = 0;
+        _cpuStartTimes[i] = 0;
+        _gpuTimes[i] = -1;
+        _openQueries[i] = 0;
+    }
+
+    for (std::size_t i = 0; i < NUM_GPU_FRAMES; ++i)
+    {
+        _gpuFrames[i].numQueries = 0;
+    }
+}
+
+
+Profiler2D::~Profiler2D()
+{
+#if !defined(TARGET_OPENGLES)
+    for (std::size_t i = 0; i < NUM_GPU_FRAMES; ++i)
+    {
+        std::vector<GpuQuery>& queries = _gpuFrames[i].queries;
+
+        for (std::size_t j = 0; j < queries.size(); ++j)
+        {
+            glDeleteQueries(1, &queries[j].startQuery);
+            glDeleteQueries(1, &queries[j].endQuery);
+        }
+    }
+#endif
+}
+
+
+void Profiler2D::setGpuTimingEnabled(bool enabled)
+{
+    _isGpuTimingEnabled = enabled;
+
+    if (!_isGpuTimingEnabled)
+    {
+        for (std::size_t i = 0; i < NUM_PHASES; ++i)
+        {
+            _gpuTimes[i] = -1;
+        }
+    }
+}
+
+
+bool Profiler2D::isGpuTimingEnabled() const
+{
+    return _isGpuTimingEnabled;
+}
+
+
+void Profiler2D::setTracing(bool tracing)
+{
+    _isTracing = tracing;
+}
+
+
+bool Profiler2D::isTracing() const
+{
+    return _isTracing;
+}
+
+
+void Profiler2D::clearTrace()
+{
+    _trace.clear();
+}
+
+
+bool Profiler2D::saveTrace(const std::string& path) const
+{
+    std::ofstream file(ofToDataPath(path, true).c_str());
+
+    if (!file)
+    {
+        ofLogError("Profiler2D::saveTrace") << "Unable to write " << path;
+        return false;
+    }
+
+    file << "{\"traceEvents\":[";
+
+    for (std::size_t i = 0; i < _trace.size(); ++i)
+    {
+        const TraceEvent& event = _trace[i];
+
+        file << (i == 0 ? "\n" : ",\n");
+
+        if (event.isCounter)
+        {
+            file << "{\"name\":\"" << event.name << "\",\"ph\":\"C\""
+                 << ",\"ts\":" << event.time
+                 << ",\"pid\":0,\"tid\":0"
+                 << ",\"args\":{\"value\":" << event.value << "}}";
+        }
+        else
+        {
+            file << "{\"name\":\"" << event.name << "\",\"ph\":\"X\""
+                 << ",\"ts\":" << event.time
+                 << ",\"dur\":" << event.duration
+                 << ",\"pid\":0,\"tid\":0}";
+        }
+    }
+
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    return file.good();
+}
+
+
+void Profiler2D::beginFrame()
+{
+    for (std::size_t i = 0; i < NUM_PHASES; ++i)
+    {
+        _cpuTimes[i] = 0;
+    }
+
+    if (_isGpuTimingEnabled && hasGpuTimers())
+    {
+        // The oldest set of queries was issued NUM_GPU_FRAMES - 1 frames
+        // ago and is reused for this frame.
+        _gpuFrameIndex = (_gpuFrameIndex + 1) % NUM_GPU_FRAMES;
+        resolve(_gpuFrames[_gpuFrameIndex]);
+    }
+
+    if (_isTracing && _trace.size() < MAX_TRACE_EVENTS)
+    {
+        TraceEvent event = { "frame", ofGetElapsedTimeMicros(), 0, 0, false };
+        _trace.push_back(event);
+    }
+}
+
+
+void Profiler2D::begin(Phase phase, bool isGpuPhase)
+{
+    _cpuStartTimes[phase] = ofGetElapsedTimeMicros();
+
+#if !defined(TARGET_OPENGLES)
+    if (isGpuPhase && _isGpuTimingEnabled && hasGpuTimers())
+    {
+        GpuFrame& frame = _gpuFrames[_gpuFrameIndex];
+
+        if (frame.numQueries == frame.queries.size())
+        {
+            GpuQuery query;
+            glGenQueries(1, &query.startQuery);
+            glGenQueries(1, &query.endQuery);
+            frame.queries.push_back(query);
+        }
+
+        GpuQuery& query = frame.queries[frame.numQueries];
+        query.phase = phase;
+        glQueryCounter(query.startQuery, GL_TIMESTAMP);
+
+        _openQueries[phase] = frame.numQueries++;
+    }
+#endif
+}
+
+
+void Profiler2D::end(Phase phase, bool isGpuPhase)
+{
+    uint64_t endTime = ofGetElapsedTimeMicros();
+    uint64_t duration = endTime - _cpuStartTimes[phase];
+
+    _cpuTimes[phase] += duration;
+
+#if !defined(TARGET_OPENGLES)
+    if (isGpuPhase && _isGpuTimingEnabled && hasGpuTimers())
+    {
+        GpuFrame& frame = _gpuFrames[_gpuFrameIndex];
+        glQueryCounter(frame.queries[_openQueries[phase]].endQuery, GL_TIMESTAMP);
+    }
+#endif
+
+    if (_isTracing && _trace.size() < MAX_TRACE_EVENTS)
+    {
+        TraceEvent event = { getPhaseName(phase),
+                             _cpuStartTimes[phase],
+                             duration,
+                             0,
+                             false };
+        _trace.push_back(event);
+    }
+}
+
+
+void Profiler2D::count(const char* name, double value)
+{
+    if (_isTracing && _trace.size() < MAX_TRACE_EVENTS)
+    {
+        TraceEvent event = { name, ofGetElapsedTimeMicros(), 0, value, true };
+        _trace.push_back(event);
+    }
+}
+
+
+uint64_t Profiler2D::getCpuTime(Phase phase) const
+{
+    return _cpuTimes[phase];
+}
+
+
+int64_t Profiler2D::getGpuTime(Phase phase) const
+{
+    return _gpuTimes[phase];
+}
+
+
+const char* Profiler2D::getPhaseName(Phase phase)
+{
+    switch (phase)
+    {
+        case PHASE_MASK:
+            return "mask";
+        case PHASE_UPLOAD:
+            return "upload";
+        case PHASE_LIGHT:
+            return "light";
+        case PHASE_COMPOSITE:
+            return "composite";
+        case NUM_PHASES:
+            break;
+    }
+
+    return "unknown";
+}
+
+
+bool Profiler2D::hasGpuTimers() const
+{
+#if defined(TARGET_OPENGLES)
+    return false;
+#else
+    static const bool hasTimers = ofGLCheckExtension("GL_ARB_timer_query");
+    return hasTimers;
+#endif
+}
+
+
+void Profiler2D::resolve(GpuFrame& frame)
+{
+#if !defined(TARGET_OPENGLES)
+    if (frame.numQueries == 0)
+    {
+        return;
+    }
+
+    // Never wait on the GPU.  If the results are late, keep the last ones.
+    GLint isAvailable = 0;
+
+    glGetQueryObjectiv(frame.queries[frame.numQueries - 1].endQuery,
+                       GL_QUERY_RESULT_AVAILABLE,
+                       &isAvailable);
+
+    if (isAvailable)
+    {
+        for (std::size_t i = 0; i < NUM_PHASES; ++i)
+        {
+            _gpuTimes[i] = 0;
+        }
+
+        for (std::size_t i = 0; i < frame.numQueries; ++i)
+        {
+            GLuint64 startTime = 0;
+            GLuint64 endTime = 0;
+
+            glGetQueryObjectui64v(frame.queries[i].startQuery,
+                                  GL_QUERY_RESULT,
+                                  &startTime);
+            glGetQueryObjectui64v(frame.queries[i].endQuery,
+                                  GL_QUERY_RESULT,
+                                  &endTime);
+
+            // Nanoseconds to microseconds.
+            _gpuTimes[frame.queries[i].phase] += (endTime - startTime) / 1000;
+        }
+    }
+
+    frame.numQueries = 0;
+#endif
+}
+
+
+} // namespace ofx
@@ -0,0 +1,137 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ofConstants.h"
+
+
+namespace ofx {
+
+
+// Per-frame phase timing for LightSystem2D.
+//
+// CPU time is measured with ofGetElapsedTimeMicros().  When GPU timing is
+// enabled and timer queries are available, each GPU phase is bracketed by
+// timestamp queries that are read back a few frames later, so the
+// pipeline never stalls.  Optionally, every phase is recorded as a Chrome
+// trace event (chrome://tracing, https://ui.perfetto.dev).
+class Profiler2D
+{
+public:
+    enum Phase
+    {
+        PHASE_MASK,
+        PHASE_UPLOAD,
+        PHASE_LIGHT,
+        PHASE_COMPOSITE,
+        NUM_PHASES
+    };
+
+    Profiler2D();
+    virtual ~Profiler2D();
+
+    void setGpuTimingEnabled(bool enabled);
+    bool isGpuTimingEnabled() const;
+
+    void setTracing(bool tracing);
+    bool isTracing() const;
+    void clearTrace();
+    bool saveTrace(const std::string& path) const;
+
+    // Start a new frame, resetting the CPU times and collecting any GPU
+    // results that have become available.
+    void beginFrame();
+
+    void begin(Phase phase, bool isGpuPhase);
+    void end(Phase phase, bool isGpuPhase);
+
+    // Record a counter value in the trace.
+    void count(const char* name, double value);
+
+    // CPU time of a phase in the current frame, in microseconds.
+    uint64_t getCpuTime(Phase phase) const;
+
+    // GPU time of a phase in the most recently resolved frame, in
+    // microseconds, or -1 if no GPU timing is available.
+    int64_t getGpuTime(Phase phase) const;
+
+    static const char* getPhaseName(Phase phase);
+
+    static const std::size_t MAX_TRACE_EVENTS;
+
+protected:
+    enum
+    {
+        NUM_GPU_FRAMES = 3
+    };
+
+    struct GpuQuery
+    {
+        Phase phase;
+        unsigned int startQuery;
+        unsigned int endQuery;
+    };
+
+    struct GpuFrame
+    {
+        std::vector<GpuQuery> queries;
+        std::size_t numQueries;
+    };
+
+    struct TraceEvent
+    {
+        const char* name;
+        uint64_t time;
+        uint64_t duration;
+        double value;
+        bool isCounter;
+    };
+
+    bool hasGpuTimers() const;
+    void resolve(GpuFrame& frame);
+
+    bool _isGpuTimingEnabled;
+    bool _isTracing;
+
+    uint64_t _cpuTimes[NUM_PHASES];
+    uint64_t _cpuStartTimes[NUM_PHASES];
+    int64_t _gpuTimes[NUM_PHASES];
+
+    GpuFrame _gpuFrames[NUM_GPU_FRAMES];
+    std::size_t _gpuFrameIndex;
+    std::size_t _openQueries[NUM_PHASES];
+
+    std::vector<TraceEvent> _trace;
+
+};
+
+
+} // namespace ofx
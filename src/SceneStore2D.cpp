@@ -0,0 +1,384 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "SceneStore2D.h"
+#include <algorithm>
+
+
+namespace ofx {
+
+
+namespace {
+
+
+// Move the last element over the removed one.
+template <typename T>
+void swapRemove(std::vector<T>& values, std::size_t index)
+{
+    values[index] = values.back();
+    values.pop_back();
+}
+
+
+}
+
+
+const uint32_t SceneStore2D::INVALID_INDEX = 0xffffffff;
+
+
+SceneStore2D::SceneStore2D():
+    _numUnusedVertices(0),
+    _numUnusedLoops(0)
+{
+}
+
+
+SceneStore2D::~SceneStore2D()
+{
+}
+
+
+void SceneStore2D::add(Shape2D::SharedPtr shape)
+{
+    if (_indices.find(shape.get()) != _indices.end())
+    {
+        return;
+    }
+
+    uint32_t index = _sources.size();
+
+    _indices[shape.get()] = index;
+    _sources.push_back(shape);
+
+    _shapes.minX.push_back(0);
+    _shapes.minY.push_back(0);
+    _shapes.maxX.push_back(0);
+    _shapes.maxY.push_back(0);
+    _shapes.first.push_back(0);
+    _shapes.count.push_back(0);
+    _shapes.firstLoop.push_back(0);
+    _shapes.numLoops.push_back(0);
+    _shapes.isStatic.push_back(0);
+    _shapes.color.push_back(shape->getColor());
+    _shapes.version.push_back(0);
+    _shapes.source.push_back(shape.get());
+
+    write(index);
+    damage(index);
+}
+
+
+void SceneStore2D::remove(const Shape2D* shape)
+{
+    std::unordered_map<const Shape2D*, uint32_t>::iterator iter = _indices.find(shape);
+
+    if (iter == _indices.end())
+    {
+        return;
+    }
+
+    uint32_t index = iter->second;
+
+    _indices.erase(iter);
+
+    damage(index);
+
+    _numUnusedVertices += _shapes.count[index];
+    _numUnusedLoops += _shapes.numLoops[index];
+
+    swapRemove(_shapes.minX, index);
+    swapRemove(_shapes.minY, index);
+    swapRemove(_shapes.maxX, index);
+    swapRemove(_shapes.maxY, index);
+    swapRemove(_shapes.first, index);
+    swapRemove(_shapes.count, index);
+    swapRemove(_shapes.firstLoop, index);
+    swapRemove(_shapes.numLoops, index);
+    swapRemove(_shapes.isStatic, index);
+    swapRemove(_shapes.color, index);
+    swapRemove(_shapes.version, index);
+    swapRemove(_shapes.source, index);
+    swapRemove(_sources, index);
+
+    if (index < _sources.size())
+    {
+        _indices[_shapes.source[index]] = index;
+    }
+}
+
+
+void SceneStore2D::clearShapes()
+{
+    for (uint32_t i = 0; i < _sources.size(); ++i)
+    {
+        damage(i);
+    }
+
+    _shapes = Shapes();
+    _vertices = Vertices();
+    _loops.clear();
+    _sources.clear();
+    _indices.clear();
+    _numUnusedVertices = 0;
+    _numUnusedLoops = 0;
+}
+
+
+void SceneStore2D::update(const Light2D::List& lights)
+{
+    std::size_t numLights = lights.size();
+
+    _lights.x.resize(numLights);
+    _lights.y.resize(numLights);
+    _lights.radius.resize(numLights);
+    _lights.angle.resize(numLights);
+    _lights.viewAngle.resize(numLights);
+    _lights.bleed.resize(numLights);
+    _lights.linearizeFactor.resize(numLights);
+    _lights.sourceRadius.resize(numLights);
+    _lights.color.resize(numLights);
+    _lights.version.resize(numLights);
+
+    for (std::size_t i = 0; i < numLights; ++i)
+    {
+        const Light2D& light = *lights[i];
+
+        _lights.x[i] = light.getPosition().x;
+        _lights.y[i] = light.getPosition().y;
+        _lights.radius[i] = light.getRadius();
+        _lights.angle[i] = light.getAngle();
+        _lights.viewAngle[i] = light.getViewAngle();
+        _lights.bleed[i] = light.getBleed();
+        _lights.linearizeFactor[i] = light.getLinearizeFactor();
+        _lights.sourceRadius[i] = light.getSourceRadius();
+        _lights.color[i] = light.getColor();
+        _lights.version[i] = light.getVersion();
+    }
+
+    for (uint32_t i = 0; i < _sources.size(); ++i)
+    {
+        if (_sources[i]->getVersion() != _shapes.version[i])
+        {
+            damage(i);
+            write(i);
+            damage(i);
+        }
+        else if (_sources[i]->getColor() != _shapes.color[i])
+        {
+            _shapes.color[i] = _sources[i]->getColor();
+            damage(i);
+        }
+    }
+
+    if (_numUnusedVertices > _vertices.x.size() / 2 ||
+        _numUnusedLoops > _loops.size() / 2)
+    {
+        compact();
+    }
+}
+
+
+uint32_t SceneStore2D::getShapeIndex(const Shape2D* shape) const
+{
+    std::unordered_map<const Shape2D*, uint32_t>::const_iterator iter = _indices.find(shape);
+    return iter != _indices.end() ? iter->second : INVALID_INDEX;
+}
+
+
+const SceneStore2D::Lights& SceneStore2D::getLights() const
+{
+    return _lights;
+}
+
+
+const SceneStore2D::Shapes& SceneStore2D::getShapes() const
+{
+    return _shapes;
+}
+
+
+const SceneStore2D::Vertices& SceneStore2D::getVertices() const
+{
+    return _vertices;
+}
+
+
+const std::vector<uint32_t>& SceneStore2D::getLoops() const
+{
+    return _loops;
+}
+
+
+const std::vector<ofRectangle>& SceneStore2D::getDamage() const
+{
+    return _damage;
+}
+
+
+void SceneStore2D::clearDamage()
+{
+    _damage.clear();
+}
+
+
+void SceneStore2D::damage(uint32_t index)
+{
+    _damage.push_back(ofRectangle(_shapes.minX[index],
+                                  _shapes.minY[index],
+                                  _shapes.maxX[index] - _shapes.minX[index],
+                                  _shapes.maxY[index] - _shapes.minY[index]));
+}
+
+
+void SceneStore2D::write(uint32_t index)
+{
+    const Shape2D& shape = *_sources[index];
+    const std::vector<ofPolyline>& loops = shape.getLoops();
+    const Shape2D::Edges& edges = shape.getEdges();
+    const ofRectangle& box = shape.getBoundingBox();
+
+    _shapes.minX[index] = box.getMinX();
+    _shapes.minY[index] = box.getMinY();
+    _shapes.maxX[index] = box.getMaxX();
+    _shapes.maxY[index] = box.getMaxY();
+    _shapes.isStatic[index] = shape.isStatic();
+    _shapes.color[index] = shape.getColor();
+    _shapes.version[index] = shape.getVersion();
+
+    uint32_t count = edges.normalX.size();
+
+    if (count > _shapes.count[index])
+    {
+        // The old range is too small; move to the end of the pool.
+        _numUnusedVertices += _shapes.count[index];
+
+        std::size_t first = _vertices.x.size();
+
+        _vertices.x.resize(first + count);
+        _vertices.y.resize(first + count);
+        _vertices.normalX.resize(first + count);
+        _vertices.normalY.resize(first + count);
+        _vertices.offset.resize(first + count);
+
+        _shapes.first[index] = first;
+    }
+    else
+    {
+        _numUnusedVertices += _shapes.count[index] - count;
+    }
+
+    _shapes.count[index] = count;
+
+    uint32_t first = _shapes.first[index];
+    uint32_t vertex = first;
+
+    for (std::size_t i = 0; i < loops.size(); ++i)
+    {
+        const ofPolyline& loop = loops[i];
+
+        for (std::size_t j = 0; j < loop.size(); ++j, ++vertex)
+        {
+            _vertices.x[vertex] = loop[j].x;
+            _vertices.y[vertex] = loop[j].y;
+        }
+    }
+
+    std::copy(edges.normalX.begin(), edges.normalX.end(), _vertices.normalX.begin() + first);
+    std::copy(edges.normalY.begin(), edges.normalY.end(), _vertices.normalY.begin() + first);
+    std::copy(edges.offset.begin(), edges.offset.end(), _vertices.offset.begin() + first);
+
+    uint32_t numLoops = loops.size();
+
+    if (numLoops > _shapes.numLoops[index])
+    {
+        _numUnusedLoops += _shapes.numLoops[index];
+        _shapes.firstLoop[index] = _loops.size();
+        _loops.resize(_loops.size() + numLoops);
+    }
+    else
+    {
+        _numUnusedLoops += _shapes.numLoops[index] - numLoops;
+    }
+
+    _shapes.numLoops[index] = numLoops;
+
+    for (uint32_t i = 0; i < numLoops; ++i)
+    {
+        _loops[_shapes.firstLoop[index] + i] = loops[i].size();
+    }
+}
+
+
+void SceneStore2D::compact()
+{
+    Vertices vertices;
+
+    std::size_t size = _vertices.x.size() - _numUnusedVertices;
+
+    vertices.x.reserve(size);
+    vertices.y.reserve(size);
+    vertices.normalX.reserve(size);
+    vertices.normalY.reserve(size);
+    vertices.offset.reserve(size);
+
+    for (std::size_t i = 0; i < _sources.size(); ++i)
+    {
+        std::size_t first = _shapes.first[i];
+        std::size_t last = first + _shapes.count[i];
+
+        _shapes.first[i] = vertices.x.size();
+
+        vertices.x.insert(vertices.x.end(), _vertices.x.begin() + first, _vertices.x.begin() + last);
+        vertices.y.insert(vertices.y.end(), _vertices.y.begin() + first, _vertices.y.begin() + last);
+        vertices.normalX.insert(vertices.normalX.end(), _vertices.normalX.begin() + first, _vertices.normalX.begin() + last);
+        vertices.normalY.insert(vertices.normalY.end(), _vertices.normalY.begin() + first, _vertices.normalY.begin() + last);
+        vertices.offset.insert(vertices.offset.end(), _vertices.offset.begin() + first, _vertices.offset.begin() + last);
+    }
+
+    std::swap(_vertices, vertices);
+
+    std::vector<uint32_t> loops;
+
+    loops.reserve(_loops.size() - _numUnusedLoops);
+
+    for (std::size_t i = 0; i < _sources.size(); ++i)
+    {
+        std::size_t first = _shapes.firstLoop[i];
+        std::size_t last = first + _shapes.numLoops[i];
+
+        _shapes.firstLoop[i] = loops.size();
+
+        loops.insert(loops.end(), _loops.begin() + first, _loops.begin() + last);
+    }
+
+    std::swap(_loops, loops);
+
+    _numUnusedVertices = 0;
+    _numUnusedLoops = 0;
+}
+
+
+} // namespace ofx
@@ -0,0 +1,152 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "Light2D.h"
+#include "Shape2D.h"
+
+
+namespace ofx {
+
+
+// A packed structure-of-arrays copy of the scene for the hot loops.
+//
+// Light2D and Shape2D remain the public handles.  The store mirrors them
+// into contiguous arrays: one entry per light, one entry per shape, and
+// the vertices and edges of every shape in one flat pool.  Shapes are only
+// copied when their version changes.  Culling and silhouette extraction
+// then stream through memory instead of chasing a pointer per element.
+class SceneStore2D
+{
+public:
+    struct Lights
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> radius;
+        std::vector<float> angle;
+        std::vector<float> viewAngle;
+        std::vector<float> bleed;
+        std::vector<float> linearizeFactor;
+        std::vector<float> sourceRadius;
+        std::vector<ofFloatColor> color;
+        std::vector<std::size_t> version;
+    };
+
+    struct Shapes
+    {
+        std::vector<float> minX;
+        std::vector<float> minY;
+        std::vector<float> maxX;
+        std::vector<float> maxY;
+
+        // The range of the shape in the vertex pool.
+        std::vector<uint32_t> first;
+        std::vector<uint32_t> count;
+
+        // The range of the shape in the loop pool.
+        std::vector<uint32_t> firstLoop;
+        std::vector<uint32_t> numLoops;
+
+        std::vector<uint8_t> isStatic;
+        std::vector<ofFloatColor> color;
+        std::vector<std::size_t> version;
+        std::vector<const Shape2D*> source;
+    };
+
+    // The loops of a shape follow one another, and edge i of a loop runs
+    // from vertex i to vertex i + 1 of that loop, as in Shape2D::Edges.
+    struct Vertices
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> normalX;
+        std::vector<float> normalY;
+        std::vector<float> offset;
+    };
+
+    SceneStore2D();
+    virtual ~SceneStore2D();
+
+    void add(Shape2D::SharedPtr shape);
+    void remove(const Shape2D* shape);
+    void clearShapes();
+
+    // Copy every light, and every shape whose version changed.
+    void update(const Light2D::List& lights);
+
+    // The bounds of the shapes added, changed, recolored or removed since
+    // the last clearDamage(), both before and after the change.
+    const std::vector<ofRectangle>& getDamage() const;
+    void clearDamage();
+
+    // The index of the shape, or INVALID_INDEX if it is not in the store.
+    // Indices change when shapes are removed.
+    uint32_t getShapeIndex(const Shape2D* shape) const;
+
+    const Lights& getLights() const;
+    const Shapes& getShapes() const;
+    const Vertices& getVertices() const;
+
+    // The number of vertices of each loop, outline first.
+    const std::vector<uint32_t>& getLoops() const;
+
+    static const uint32_t INVALID_INDEX;
+
+protected:
+    void write(uint32_t index);
+
+    // Add the stored bounds of the shape to the damage.
+    void damage(uint32_t index);
+
+    // Rewrite the vertex and loop pools without the ranges of changed or
+    // removed shapes.
+    void compact();
+
+    Lights _lights;
+    Shapes _shapes;
+    Vertices _vertices;
+    std::vector<uint32_t> _loops;
+
+    std::vector<ofRectangle> _damage;
+
+    // Keeps the shapes alive and in step with _shapes.
+    Shape2D::List _sources;
+
+    std::unordered_map<const Shape2D*, uint32_t> _indices;
+
+    std::size_t _numUnusedVertices;
+    std::size_t _numUnusedLoops;
+
+};
+
+
+} // namespace ofx
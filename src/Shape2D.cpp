@@ -26,6 +26,8 @@
 #include "Shape2D.h"
 #include "ofGraphics.h"
 #include "ofAppRunner.h"
+#include "ofTessellator.h"
+#include <algorithm>
 
 
 namespace ofx {
@@ -33,6 +35,9 @@ namespace ofx {
 
 Shape2D::Shape2D():
     _color(.5, 1),
+    _isConvex(true),
+    _isStatic(false),
+    _version(0),
     _isMeshDirty(true)
 {
 }
@@ -60,8 +65,70 @@ void Shape2D::draw()
 
 void Shape2D::setShape(const ofPolyline& shape)
 {
-    _shape = shape;
+    setShape(std::vector<ofPolyline>(1, shape));
+}
+
+
+void Shape2D::setShape(const std::vector<ofPolyline>& loops)
+{
+    _loops = loops;
+
+    if (_loops.empty())
+    {
+        _loops.push_back(ofPolyline());
+    }
+
+    _edges.normalX.clear();
+    _edges.normalY.clear();
+    _edges.offset.clear();
+
+    _isConvex = _loops.size() == 1;
+
+    for (std::size_t i = 0; i < _loops.size(); ++i)
+    {
+        ofPolyline& loop = _loops[i];
+
+        // Wind the outline one way and the holes the other, so that every
+        // edge has the solid on its normal's side and faces away from a
+        // light on that side.
+        if ((getSignedArea(loop) < 0) == (i == 0))
+        {
+            std::reverse(loop.getVertices().begin(), loop.getVertices().end());
+        }
+
+        std::size_t numEdges = loop.size();
+
+        for (std::size_t j = 0; j < numEdges; ++j)
+        {
+            const ofPoint& firstVertex = loop[j];
+            const ofPoint& secondVertex = loop[(j + 1) % numEdges];
+            const ofPoint& thirdVertex = loop[(j + 2) % numEdges];
+
+            float normalX = - (secondVertex.y - firstVertex.y);
+            float normalY =    secondVertex.x - firstVertex.x;
+
+            _edges.normalX.push_back(normalX);
+            _edges.normalY.push_back(normalY);
+            _edges.offset.push_back(normalX * (firstVertex.x + secondVertex.x) / 2 +
+                                    normalY * (firstVertex.y + secondVertex.y) / 2);
+
+            // Convex while every turn goes the same way as the outline.
+            float turn = normalX * (thirdVertex.x - secondVertex.x) +
+                         normalY * (thirdVertex.y - secondVertex.y);
+
+            if (turn < 0)
+            {
+                _isConvex = false;
+            }
+        }
+    }
+
+    _shape = _loops[0];
     _position = _shape.getCentroid2D();
+    _boundingBox = _shape.getBoundingBox();
+
+    _isMeshDirty = true;
+    ++_version;
 }
 
 
@@ -71,12 +138,49 @@ const ofPolyline& Shape2D::getShape() const
 }
 
 
+const Shape2D::Edges& Shape2D::getEdges() const
+{
+    return _edges;
+}
+
+
 ofVec3f Shape2D::getCenter() const
 {
     return _position;
 }
 
 
+const ofRectangle& Shape2D::getBoundingBox() const
+{
+    return _boundingBox;
+}
+
+
+const std::vector<ofPolyline>& Shape2D::getLoops() const
+{
+    return _loops;
+}
+
+
+std::size_t Shape2D::getVersion() const
+{
+    return _version;
+}
+
+
+void Shape2D::setStatic(bool isStatic)
+{
+    _isStatic = isStatic;
+    ++_version;
+}
+
+
+bool Shape2D::isStatic() const
+{
+    return _isStatic;
+}
+
+
 void Shape2D::setColor(const ofFloatColor& color)
 {
     _color = color;
@@ -92,6 +196,26 @@ ofFloatColor Shape2D::getColor() const
 
 void Shape2D::createMesh() const
 {
+    ofFloatColor color(_color);
+    color = color * .8;
+
+    // Concave shapes and shapes with holes can not be drawn as a fan.
+    if (!_isConvex)
+    {
+        ofTessellator tessellator;
+        tessellator.tessellateToMesh(_loops, OF_POLY_WINDING_ODD, _mesh, true);
+
+        _mesh.clearColors();
+
+        for (std::size_t i = 0; i < _mesh.getNumVertices(); ++i)
+        {
+            _mesh.addColor(color);
+        }
+
+        _isMeshDirty = false;
+        return;
+    }
+
     _mesh.clear();
     _mesh.setMode(OF_PRIMITIVE_TRIANGLE_FAN);
 
@@ -99,9 +223,6 @@ void Shape2D::createMesh() const
 
     _mesh.addVertex(position);
 
-    ofFloatColor color(_color);
-    color = color * .8;
-
     _mesh.addColor(_color);
 
 	for (std::size_t i = 0; i < _shape.size(); ++i)
@@ -117,4 +238,20 @@ void Shape2D::createMesh() const
 }
 
 
+float Shape2D::getSignedArea(const ofPolyline& loop)
+{
+    float area = 0;
+
+    for (std::size_t i = 0; i < loop.size(); ++i)
+    {
+        const ofPoint& a = loop[i];
+        const ofPoint& b = loop[(i + 1) % loop.size()];
+
+        area += a.x * b.y - b.x * a.y;
+    }
+
+    return area / 2;
+}
+
+
 } // namespace ofx
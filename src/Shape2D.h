@@ -30,6 +30,7 @@
 #include "ofColor.h"
 #include "ofMesh.h"
 #include "ofPolyline.h"
+#include "ofRectangle.h"
 
 
 namespace ofx {
@@ -41,6 +42,16 @@ public:
     typedef std::shared_ptr<Shape2D> SharedPtr;
     typedef std::vector<SharedPtr> List;
 
+    // Per-edge data in structure-of-arrays form for
+    // Silhouette2D::classifyEdges.  Edge i runs from vertex i to vertex i + 1
+    // of the same loop, the last edge of a loop back to its first vertex.
+    struct Edges
+    {
+        std::vector<float> normalX;
+        std::vector<float> normalY;
+        std::vector<float> offset;
+    };
+
     Shape2D();
     virtual ~Shape2D();
 
@@ -48,10 +59,30 @@ public:
     void draw();
 
     void setShape(const ofPolyline& shape);
+
+    // Set an outline and the holes in it.  The polygons may be concave.
+    // The holes are wound opposite to the outline.
+    void setShape(const std::vector<ofPolyline>& loops);
+
+    // The outline.
     const ofPolyline& getShape() const;
 
+    // The outline followed by the holes.
+    const std::vector<ofPolyline>& getLoops() const;
+
+    const Edges& getEdges() const;
+
     ofVec3f getCenter() const;
 
+    const ofRectangle& getBoundingBox() const;
+
+    std::size_t getVersion() const;
+
+    // Static shapes may be baked into the light of static lights; see
+    // Light2D::setStatic().
+    void setStatic(bool isStatic);
+    bool isStatic() const;
+
     void setColor(const ofFloatColor& color);
     ofFloatColor getColor() const;
 
@@ -62,7 +93,23 @@ protected:
 
     ofPolyline _shape;
 
+    std::vector<ofPolyline> _loops;
+
+    bool _isConvex;
+
+    bool _isStatic;
+
+    Edges _edges;
+
+    ofRectangle _boundingBox;
+
+    std::size_t _version;
+
     void createMesh() const;
+
+    // Positive for one winding and negative for the other.
+    static float getSignedArea(const ofPolyline& loop);
+
     mutable bool _isMeshDirty;
 
     mutable ofMesh _mesh;
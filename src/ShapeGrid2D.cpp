@@ -0,0 +1,306 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "ShapeGrid2D.h"
+#include <algorithm>
+#include <cmath>
+
+
+namespace ofx {
+
+
+const float ShapeGrid2D::DEFAULT_CELL_SIZE = 128;
+
+
+ShapeGrid2D::ShapeGrid2D(float cellSize):
+    _cellSize(cellSize),
+    _nextOrder(0)
+{
+}
+
+
+ShapeGrid2D::~ShapeGrid2D()
+{
+}
+
+
+void ShapeGrid2D::setCellSize(float cellSize)
+{
+    if (cellSize <= 0 || cellSize == _cellSize)
+    {
+        return;
+    }
+
+    _cellSize = cellSize;
+    _cells.clear();
+
+    EntryMap::iterator iter = _entries.begin();
+
+    while (iter != _entries.end())
+    {
+        link(iter->second);
+        ++iter;
+    }
+}
+
+
+float ShapeGrid2D::getCellSize() const
+{
+    return _cellSize;
+}
+
+
+void ShapeGrid2D::insert(Shape2D::SharedPtr shape)
+{
+    if (!shape || _entries.find(shape.get()) != _entries.end())
+    {
+        return;
+    }
+
+    Entry& entry = _entries[shape.get()];
+    entry.shape = shape;
+    entry.order = _nextOrder++;
+    link(entry);
+}
+
+
+void ShapeGrid2D::remove(Shape2D::SharedPtr shape)
+{
+    EntryMap::iterator iter = _entries.find(shape.get());
+
+    if (iter != _entries.end())
+    {
+        const Entry& entry = iter->second;
+
+        unlink(entry);
+        eraseEmptyCells(entry.minX, entry.minY, entry.maxX, entry.maxY);
+
+        _entries.erase(iter);
+    }
+}
+
+
+void ShapeGrid2D::clear()
+{
+    _entries.clear();
+    _cells.clear();
+}
+
+
+void ShapeGrid2D::update()
+{
+    EntryMap::iterator iter = _entries.begin();
+
+    while (iter != _entries.end())
+    {
+        Entry& entry = iter->second;
+
+        if (entry.version != entry.shape->getVersion())
+        {
+            int minX = entry.minX;
+            int minY = entry.minY;
+            int maxX = entry.maxX;
+            int maxY = entry.maxY;
+
+            unlink(entry);
+            link(entry);
+
+            // Cells the shape left empty are erased, so that shapes moving
+            // across the world do not leave a trail of them to walk.
+            eraseEmptyCells(minX, minY, maxX, maxY);
+        }
+
+        ++iter;
+    }
+}
+
+
+std::size_t ShapeGrid2D::query(const ofRectangle& region,
+                               std::vector<const Shape2D*>& shapes) const
+{
+    // Reused by each thread, so that steady-state queries do not allocate.
+    static thread_local std::vector<const Entry*> results;
+
+    results.clear();
+
+    find(region, results);
+
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        shapes.push_back(results[i]->shape.get());
+    }
+
+    return results.size();
+}
+
+
+std::size_t ShapeGrid2D::size() const
+{
+    return _entries.size();
+}
+
+
+void ShapeGrid2D::find(const ofRectangle& region,
+                       std::vector<const Entry*>& results) const
+{
+    int minX = cellCoordinate(region.getMinX());
+    int minY = cellCoordinate(region.getMinY());
+    int maxX = cellCoordinate(region.getMaxX());
+    int maxY = cellCoordinate(region.getMaxY());
+
+    double numRegionCells = (double(maxX) - minX + 1) * (double(maxY) - minY + 1);
+
+    if (numRegionCells > _cells.size())
+    {
+        // The region covers more cells than are occupied, so walk the
+        // occupied cells instead of probing every empty one.
+        CellMap::const_iterator cellIter = _cells.begin();
+
+        while (cellIter != _cells.end())
+        {
+            collect(cellIter->second, region, results);
+            ++cellIter;
+        }
+    }
+    else
+    {
+        for (int y = minY; y <= maxY; ++y)
+        {
+            for (int x = minX; x <= maxX; ++x)
+            {
+                CellMap::const_iterator cellIter = _cells.find(cellKey(x, y));
+
+                if (cellIter != _cells.end())
+                {
+                    collect(cellIter->second, region, results);
+                }
+            }
+        }
+    }
+
+    // Shapes spanning several cells are found more than once.
+    std::sort(results.begin(), results.end(), entryOrder);
+    results.erase(std::unique(results.begin(), results.end()), results.end());
+}
+
+
+void ShapeGrid2D::link(Entry& entry)
+{
+    const ofRectangle& box = entry.shape->getBoundingBox();
+
+    entry.version = entry.shape->getVersion();
+    entry.minX = cellCoordinate(box.getMinX());
+    entry.minY = cellCoordinate(box.getMinY());
+    entry.maxX = cellCoordinate(box.getMaxX());
+    entry.maxY = cellCoordinate(box.getMaxY());
+
+    for (int y = entry.minY; y <= entry.maxY; ++y)
+    {
+        for (int x = entry.minX; x <= entry.maxX; ++x)
+        {
+            _cells[cellKey(x, y)].push_back(&entry);
+        }
+    }
+}
+
+
+void ShapeGrid2D::unlink(const Entry& entry)
+{
+    for (int y = entry.minY; y <= entry.maxY; ++y)
+    {
+        for (int x = entry.minX; x <= entry.maxX; ++x)
+        {
+            CellMap::iterator cellIter = _cells.find(cellKey(x, y));
+
+            if (cellIter == _cells.end())
+            {
+                continue;
+            }
+
+            Cell& cell = cellIter->second;
+            cell.erase(std::remove(cell.begin(), cell.end(), &entry), cell.end());
+        }
+    }
+}
+
+
+void ShapeGrid2D::eraseEmptyCells(int minX, int minY, int maxX, int maxY)
+{
+    for (int y = minY; y <= maxY; ++y)
+    {
+        for (int x = minX; x <= maxX; ++x)
+        {
+            CellMap::iterator cellIter = _cells.find(cellKey(x, y));
+
+            if (cellIter != _cells.end() && cellIter->second.empty())
+            {
+                _cells.erase(cellIter);
+            }
+        }
+    }
+}
+
+
+void ShapeGrid2D::collect(const Cell& cell,
+                          const ofRectangle& region,
+                          std::vector<const Entry*>& results)
+{
+    for (std::size_t i = 0; i < cell.size(); ++i)
+    {
+        const ofRectangle& box = cell[i]->shape->getBoundingBox();
+
+        // Inclusive, so that axis-aligned segments with an empty box are kept.
+        if (box.getMinX() <= region.getMaxX() &&
+            box.getMaxX() >= region.getMinX() &&
+            box.getMinY() <= region.getMaxY() &&
+            box.getMaxY() >= region.getMinY())
+        {
+            results.push_back(cell[i]);
+        }
+    }
+}
+
+
+bool ShapeGrid2D::entryOrder(const Entry* a, const Entry* b)
+{
+    return a->order < b->order;
+}
+
+
+uint64_t ShapeGrid2D::cellKey(int x, int y) const
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) |
+            static_cast<uint64_t>(static_cast<uint32_t>(y));
+}
+
+
+int ShapeGrid2D::cellCoordinate(float value) const
+{
+    return static_cast<int>(std::floor(value / _cellSize));
+}
+
+
+} // namespace ofx
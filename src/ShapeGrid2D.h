@@ -0,0 +1,108 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include "Shape2D.h"
+#include "ofRectangle.h"
+
+
+namespace ofx {
+
+
+class ShapeGrid2D
+{
+public:
+    ShapeGrid2D(float cellSize = DEFAULT_CELL_SIZE);
+    virtual ~ShapeGrid2D();
+
+    void setCellSize(float cellSize);
+    float getCellSize() const;
+
+    void insert(Shape2D::SharedPtr shape);
+    void remove(Shape2D::SharedPtr shape);
+    void clear();
+
+    // Re-bin any shapes whose geometry changed since the last update.
+    void update();
+
+    // Append every shape whose bounding box overlaps the region to the list,
+    // in insertion order.  Returns the number of shapes appended.
+    std::size_t query(const ofRectangle& region,
+                      std::vector<const Shape2D*>& shapes) const;
+
+    std::size_t size() const;
+
+    static const float DEFAULT_CELL_SIZE;
+
+protected:
+    struct Entry
+    {
+        Shape2D::SharedPtr shape;
+        std::size_t version;
+        std::size_t order;
+        int minX;
+        int minY;
+        int maxX;
+        int maxY;
+    };
+
+    typedef std::map<const Shape2D*, Entry> EntryMap;
+    typedef std::vector<const Entry*> Cell;
+    typedef std::unordered_map<uint64_t, Cell> CellMap;
+
+    void link(Entry& entry);
+    void unlink(const Entry& entry);
+
+    // Erase the empty cells in the range of cell coordinates.
+    void eraseEmptyCells(int minX, int minY, int maxX, int maxY);
+
+    // Every entry overlapping the region, in insertion order.
+    void find(const ofRectangle& region, std::vector<const Entry*>& results) const;
+
+    static void collect(const Cell& cell,
+                        const ofRectangle& region,
+                        std::vector<const Entry*>& results);
+
+    static bool entryOrder(const Entry* a, const Entry* b);
+
+    uint64_t cellKey(int x, int y) const;
+    int cellCoordinate(float value) const;
+
+    float _cellSize;
+    std::size_t _nextOrder;
+
+    EntryMap _entries;
+    CellMap _cells;
+
+};
+
+
+} // namespace ofx
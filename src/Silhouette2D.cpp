@@ -0,0 +1,212 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "Silhouette2D.h"
+
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OFX_LIGHT2D_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+namespace ofx {
+
+
+std::size_t Silhouette2D::getNumWords(std::size_t numEdges)
+{
+    return (numEdges + BITS_PER_WORD - 1) / BITS_PER_WORD;
+}
+
+
+void Silhouette2D::classifyEdges(const float* normalX,
+                                 const float* normalY,
+                                 const float* offset,
+                                 std::size_t numEdges,
+                                 float lightX,
+                                 float lightY,
+                                 Word* mask)
+{
+    for (std::size_t i = 0; i < getNumWords(numEdges); ++i)
+    {
+        mask[i] = 0;
+    }
+
+    std::size_t i = 0;
+
+#if defined(__AVX__)
+    const __m256 x = _mm256_set1_ps(lightX);
+    const __m256 y = _mm256_set1_ps(lightY);
+
+    // 8 edges at a time; 8 divides 64, so a group never spans two words.
+    for (; i + 8 <= numEdges; i += 8)
+    {
+        __m256 dot = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(normalX + i), x),
+                                   _mm256_mul_ps(_mm256_loadu_ps(normalY + i), y));
+
+        Word bits = _mm256_movemask_ps(_mm256_cmp_ps(dot,
+                                                     _mm256_loadu_ps(offset + i),
+                                                     _CMP_GT_OQ));
+
+        mask[i / BITS_PER_WORD] |= bits << (i % BITS_PER_WORD);
+    }
+#elif defined(OFX_LIGHT2D_SSE2)
+    const __m128 x = _mm_set1_ps(lightX);
+    const __m128 y = _mm_set1_ps(lightY);
+
+    for (; i + 4 <= numEdges; i += 4)
+    {
+        __m128 dot = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(normalX + i), x),
+                                _mm_mul_ps(_mm_loadu_ps(normalY + i), y));
+
+        Word bits = _mm_movemask_ps(_mm_cmpgt_ps(dot, _mm_loadu_ps(offset + i)));
+
+        mask[i / BITS_PER_WORD] |= bits << (i % BITS_PER_WORD);
+    }
+#endif
+
+    for (; i < numEdges; ++i)
+    {
+        if (normalX[i] * lightX + normalY[i] * lightY > offset[i])
+        {
+            mask[i / BITS_PER_WORD] |= Word(1) << (i % BITS_PER_WORD);
+        }
+    }
+}
+
+
+void Silhouette2D::findRuns(const Word* mask,
+                            std::size_t numEdges,
+                            std::vector<Run>& runs)
+{
+    const std::size_t numWords = getNumWords(numEdges);
+
+    bool hasStart = false;
+    bool hasTransitions = false;
+
+    uint32_t start = 0;
+
+    // The end of the run that wraps around from the last edge to the
+    // first, which is found before its start.
+    uint32_t wrappedEnd = 0;
+
+    for (std::size_t w = 0; w < numWords; ++w)
+    {
+        Word current = mask[w];
+        Word next = current >> 1;
+        Word valid = ~Word(0);
+
+        // Bit i of next holds the state of edge i + 1, wrapping around from
+        // the last edge to the first.
+        if (w + 1 < numWords)
+        {
+            next |= (mask[w + 1] & 1) << (BITS_PER_WORD - 1);
+        }
+        else
+        {
+            std::size_t numBits = numEdges - w * BITS_PER_WORD;
+
+            next |= (mask[0] & 1) << (numBits - 1);
+
+            if (numBits < BITS_PER_WORD)
+            {
+                valid = (Word(1) << numBits) - 1;
+            }
+        }
+
+        Word transitions = (current ^ next) & valid;
+        Word rising = transitions & next;
+
+        hasTransitions = hasTransitions || transitions;
+
+        // Starts and ends alternate, so they are paired in index order.
+        while (transitions)
+        {
+            std::size_t bit = lowestBit(transitions);
+            uint32_t index = w * BITS_PER_WORD + bit;
+
+            if (rising & (Word(1) << bit))
+            {
+                start = (index + 1) % numEdges;
+                hasStart = true;
+            }
+            else if (hasStart)
+            {
+                Run run = { start, index - start + 1 };
+                runs.push_back(run);
+                hasStart = false;
+            }
+            else
+            {
+                wrappedEnd = index;
+            }
+
+            transitions &= transitions - 1;
+        }
+    }
+
+    if (hasStart)
+    {
+        Run run = { start, uint32_t((wrappedEnd + numEdges - start) % numEdges + 1) };
+        runs.push_back(run);
+    }
+    else if (!hasTransitions && numEdges > 0 && (mask[0] & 1))
+    {
+        Run run = { 0, uint32_t(numEdges) };
+        runs.push_back(run);
+    }
+}
+
+
+std::size_t Silhouette2D::lowestBit(Word word)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return index;
+#elif defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    std::size_t index = 0;
+
+    while (!(word & 1))
+    {
+        word >>= 1;
+        ++index;
+    }
+
+    return index;
+#endif
+}
+
+
+} // namespace ofx
@@ -0,0 +1,87 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace ofx {
+
+
+// Kernels used to find the silhouette of a polygon as seen from a light.
+//
+// Edges are passed as structure-of-arrays: edge i has the (unnormalized)
+// normal (normalX[i], normalY[i]) and offset[i] = normal · midpoint.  An
+// edge is back facing when normal · light > offset.
+class Silhouette2D
+{
+public:
+    typedef uint64_t Word;
+
+    enum
+    {
+        BITS_PER_WORD = 64
+    };
+
+    // A run of consecutive back facing edges, from edge first to edge
+    // (first + count - 1) % numEdges.
+    struct Run
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    // The number of words needed to store one bit per edge.
+    static std::size_t getNumWords(std::size_t numEdges);
+
+    // Set bit i of the mask when edge i is back facing.  Uses AVX or SSE2
+    // when the compiler targets them, otherwise a scalar loop.
+    static void classifyEdges(const float* normalX,
+                              const float* normalY,
+                              const float* offset,
+                              std::size_t numEdges,
+                              float lightX,
+                              float lightY,
+                              Word* mask);
+
+    // Append every run of back facing edges of the closed polygon to runs,
+    // in one pass over the mask.  A polygon that is back facing all around,
+    // as seen from inside it, is one run of numEdges edges from edge 0.
+    static void findRuns(const Word* mask,
+                         std::size_t numEdges,
+                         std::vector<Run>& runs);
+
+    // The index of the lowest set bit of a non-zero word.
+    static std::size_t lowestBit(Word word);
+
+};
+
+
+} // namespace ofx
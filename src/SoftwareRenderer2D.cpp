@@ -0,0 +1,457 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "SoftwareRenderer2D.h"
+#include <algorithm>
+#include <cmath>
+
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OFX_LIGHT2D_SSE2
+#endif
+
+
+namespace ofx {
+
+
+const int SoftwareRenderer2D::DEFAULT_TILE_SIZE = 64;
+
+
+SoftwareRenderer2D::SoftwareRenderer2D():
+    _tileSize(DEFAULT_TILE_SIZE),
+    _cellWidth(1),
+    _cellHeight(1),
+    _numTilesX(0)
+{
+}
+
+
+SoftwareRenderer2D::~SoftwareRenderer2D()
+{
+}
+
+
+void SoftwareRenderer2D::setTileSize(int tileSize)
+{
+    // Keep rows a multiple of the SIMD width.
+    _tileSize = std::max(4, (tileSize + 3) / 4 * 4);
+}
+
+
+int SoftwareRenderer2D::getTileSize() const
+{
+    return _tileSize;
+}
+
+
+void SoftwareRenderer2D::clear()
+{
+    _lights.clear();
+    _fans.clear();
+}
+
+
+void SoftwareRenderer2D::add(const Light2D& light, const ofMesh* shadows)
+{
+    Light entry = makeLight(light);
+    entry.shadows = shadows;
+
+    // Place the fan the same way Light2D::draw does.
+    const ofMesh& mesh = light.getMesh();
+    const std::vector<ofVec3f>& vertices = mesh.getVertices();
+
+    float rotation = light.getAngle() - light.getViewAngle() / 2.0;
+    float cosine = cos(rotation);
+    float sine = sin(rotation);
+
+    for (std::size_t i = 1; i + 1 < vertices.size(); ++i)
+    {
+        const ofVec3f* triangle[3] = { &vertices[0], &vertices[i], &vertices[i + 1] };
+
+        for (std::size_t j = 0; j < 3; ++j)
+        {
+            _fans.push_back(ofVec2f(entry.position.x + triangle[j]->x * cosine - triangle[j]->y * sine,
+                                    entry.position.y + triangle[j]->x * sine + triangle[j]->y * cosine));
+        }
+    }
+
+    entry.numTriangles = _fans.size() / 3 - entry.firstTriangle;
+
+    _lights.push_back(entry);
+}
+
+
+void SoftwareRenderer2D::addRegion(const Light2D& light, const ofMesh& region)
+{
+    Light entry = makeLight(light);
+
+    const std::vector<ofVec3f>& vertices = region.getVertices();
+    const std::vector<ofIndexType>& indices = region.getIndices();
+
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        _fans.push_back(vertices[indices[i]]);
+        _fans.push_back(vertices[indices[i + 1]]);
+        _fans.push_back(vertices[indices[i + 2]]);
+    }
+
+    entry.numTriangles = _fans.size() / 3 - entry.firstTriangle;
+
+    _lights.push_back(entry);
+}
+
+
+SoftwareRenderer2D::Light SoftwareRenderer2D::makeLight(const Light2D& light) const
+{
+    Light entry;
+    entry.position = light.getPosition();
+    entry.color = light.getColor();
+    entry.radius = light.getRadius();
+    entry.bleed = light.getBleed();
+    entry.linearizeFactor = light.getLinearizeFactor();
+    entry.bounds = light.getBoundingBox();
+    entry.firstTriangle = _fans.size() / 3;
+    entry.numTriangles = 0;
+    entry.shadows = 0;
+    return entry;
+}
+
+
+void SoftwareRenderer2D::render(const ofRectangle& region,
+                                ofFloatPixels& pixels,
+                                WorkerPool& workers)
+{
+    const int width = pixels.getWidth();
+    const int height = pixels.getHeight();
+
+    if (width == 0 || height == 0 || region.width == 0 || region.height == 0)
+    {
+        return;
+    }
+
+    _region = region;
+    _cellWidth = region.width / width;
+    _cellHeight = region.height / height;
+    _numTilesX = (width + _tileSize - 1) / _tileSize;
+
+    _tiles.clear();
+
+    for (int y = 0; y < height; y += _tileSize)
+    {
+        for (int x = 0; x < width; x += _tileSize)
+        {
+            Tile tile;
+            tile.x = x;
+            tile.y = y;
+            tile.width = std::min(_tileSize, width - x);
+            tile.height = std::min(_tileSize, height - y);
+            _tiles.push_back(tile);
+        }
+    }
+
+    const std::size_t tileArea = _tileSize * _tileSize;
+
+    _buffer.assign(_tiles.size() * 4 * tileArea, 0);
+
+    workers.run(_tiles.size(), [this](std::size_t i) {
+        renderTile(i);
+    });
+
+    // Resolve the tiles, clamping like the 8-bit composite targets.
+    const std::size_t numChannels = pixels.getNumChannels();
+    float* data = pixels.getData();
+
+    for (std::size_t i = 0; i < _tiles.size(); ++i)
+    {
+        const Tile& tile = _tiles[i];
+        const float* planes = &_buffer[i * 4 * tileArea];
+
+        for (int y = 0; y < tile.height; ++y)
+        {
+            for (int x = 0; x < tile.width; ++x)
+            {
+                float* pixel = data + ((tile.y + y) * width + tile.x + x) * numChannels;
+
+                for (std::size_t channel = 0; channel < std::min<std::size_t>(numChannels, 4); ++channel)
+                {
+                    pixel[channel] = std::min(std::max(planes[channel * tileArea + y * _tileSize + x], 0.0f), 1.0f);
+                }
+            }
+        }
+    }
+}
+
+
+void SoftwareRenderer2D::renderTile(std::size_t index)
+{
+    const Tile& tile = _tiles[index];
+    const std::size_t tileArea = _tileSize * _tileSize;
+
+    ofRectangle bounds(_region.x + tile.x * _cellWidth,
+                       _region.y + tile.y * _cellHeight,
+                       tile.width * _cellWidth,
+                       tile.height * _cellHeight);
+
+    float* accumulator = &_buffer[index * 4 * tileArea];
+
+    std::vector<float> coverage(tileArea);
+
+    for (std::size_t i = 0; i < _lights.size(); ++i)
+    {
+        const Light& light = _lights[i];
+
+        if (light.bounds.getMinX() > bounds.getMaxX() ||
+            light.bounds.getMaxX() < bounds.getMinX() ||
+            light.bounds.getMinY() > bounds.getMaxY() ||
+            light.bounds.getMaxY() < bounds.getMinY())
+        {
+            continue;
+        }
+
+        std::fill(coverage.begin(), coverage.end(), 0.0f);
+
+        for (std::size_t j = 0; j < light.numTriangles; ++j)
+        {
+            const ofVec2f* triangle = &_fans[(light.firstTriangle + j) * 3];
+            rasterize(tile, triangle[0], triangle[1], triangle[2], 1, false, &coverage[0]);
+        }
+
+        if (light.shadows)
+        {
+            // The masks are black, or shaded by their penumbra, and drawn
+            // with a multiply blend.
+            const std::vector<ofVec3f>& vertices = light.shadows->getVertices();
+            const std::vector<ofVec2f>& texCoords = light.shadows->getTexCoords();
+            const std::vector<ofIndexType>& indices = light.shadows->getIndices();
+
+            bool hasTexCoords = light.shadows->hasTexCoords();
+
+            for (std::size_t j = 0; j + 2 < indices.size(); j += 3)
+            {
+                ofVec2f fin[3];
+
+                if (hasTexCoords)
+                {
+                    fin[0] = texCoords[indices[j]];
+                    fin[1] = texCoords[indices[j + 1]];
+                    fin[2] = texCoords[indices[j + 2]];
+                }
+
+                rasterize(tile,
+                          vertices[indices[j]],
+                          vertices[indices[j + 1]],
+                          vertices[indices[j + 2]],
+                          0,
+                          true,
+                          &coverage[0],
+                          hasTexCoords ? fin : 0);
+            }
+        }
+
+        shade(tile, light, &coverage[0], accumulator);
+    }
+}
+
+
+void SoftwareRenderer2D::rasterize(const Tile& tile,
+                                   const ofVec2f& a,
+                                   const ofVec2f& b,
+                                   const ofVec2f& c,
+                                   float value,
+                                   bool multiply,
+                                   float* coverage,
+                                   const ofVec2f* texCoords) const
+{
+    // Work in tile pixel space, where pixel centers lie on integers.
+    ofVec2f p[3] = {
+        ofVec2f((a.x - _region.x) / _cellWidth - 0.5f - tile.x, (a.y - _region.y) / _cellHeight - 0.5f - tile.y),
+        ofVec2f((b.x - _region.x) / _cellWidth - 0.5f - tile.x, (b.y - _region.y) / _cellHeight - 0.5f - tile.y),
+        ofVec2f((c.x - _region.x) / _cellWidth - 0.5f - tile.x, (c.y - _region.y) / _cellHeight - 0.5f - tile.y)
+    };
+
+    int minX = std::max(0, (int)std::ceil(std::min(p[0].x, std::min(p[1].x, p[2].x))));
+    int maxX = std::min(tile.width - 1, (int)std::floor(std::max(p[0].x, std::max(p[1].x, p[2].x))));
+    int minY = std::max(0, (int)std::ceil(std::min(p[0].y, std::min(p[1].y, p[2].y))));
+    int maxY = std::min(tile.height - 1, (int)std::floor(std::max(p[0].y, std::max(p[1].y, p[2].y))));
+
+    if (minX > maxX || minY > maxY)
+    {
+        return;
+    }
+
+    // Edge functions e(x, y) = A * x + B * y + C for the three edges.
+    float A[3];
+    float B[3];
+    float C[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const ofVec2f& from = p[i];
+        const ofVec2f& to = p[(i + 1) % 3];
+
+        A[i] = -(to.y - from.y);
+        B[i] = to.x - from.x;
+        C[i] = -(A[i] * from.x + B[i] * from.y);
+    }
+
+    // Twice the signed area, for the barycentric weights e1, e2 and e0 of
+    // a, b and c.
+    float area = C[0] + C[1] + C[2];
+
+    for (int y = minY; y <= maxY; ++y)
+    {
+        float e0 = A[0] * minX + B[0] * y + C[0];
+        float e1 = A[1] * minX + B[1] * y + C[1];
+        float e2 = A[2] * minX + B[2] * y + C[2];
+
+        float* row = coverage + y * _tileSize;
+
+        for (int x = minX; x <= maxX; ++x)
+        {
+            // Inside for either winding; points on an edge count as inside.
+            if ((e0 >= 0 && e1 >= 0 && e2 >= 0) || (e0 <= 0 && e1 <= 0 && e2 <= 0))
+            {
+                float sample = value;
+
+                if (texCoords && area != 0)
+                {
+                    sample = Light2D::getPenumbra((texCoords[0] * e1 +
+                                                   texCoords[1] * e2 +
+                                                   texCoords[2] * e0) / area);
+                }
+
+                row[x] = multiply ? row[x] * sample : sample;
+            }
+
+            e0 += A[0];
+            e1 += A[1];
+            e2 += A[2];
+        }
+    }
+}
+
+
+void SoftwareRenderer2D::shade(const Tile& tile,
+                               const Light& light,
+                               const float* coverage,
+                               float* accumulator) const
+{
+    const std::size_t tileArea = _tileSize * _tileSize;
+
+    float* red = accumulator;
+    float* green = accumulator + tileArea;
+    float* blue = accumulator + 2 * tileArea;
+    float* alpha = accumulator + 3 * tileArea;
+
+    const float linearFalloff = light.linearizeFactor / light.radius;
+
+    for (int y = 0; y < tile.height; ++y)
+    {
+        const float dy = _region.y + (tile.y + y + 0.5f) * _cellHeight - light.position.y;
+        const float dy2 = dy * dy;
+        const float x0 = _region.x + (tile.x + 0.5f) * _cellWidth - light.position.x;
+
+        const std::size_t row = y * _tileSize;
+
+        int x = 0;
+
+#if defined(OFX_LIGHT2D_SSE2)
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1);
+        const __m128 radius = _mm_set1_ps(light.radius);
+        const __m128 linear = _mm_set1_ps(linearFalloff);
+        const __m128 bleed = _mm_set1_ps(light.bleed);
+        const __m128 offsets = _mm_set_ps(3, 2, 1, 0);
+
+        for (; x + 4 <= tile.width; x += 4)
+        {
+            __m128 cover = _mm_loadu_ps(coverage + row + x);
+
+            if (_mm_movemask_ps(_mm_cmpgt_ps(cover, zero)) == 0)
+            {
+                continue;
+            }
+
+            __m128 dx = _mm_add_ps(_mm_set1_ps(x0 + x * _cellWidth),
+                                   _mm_mul_ps(offsets, _mm_set1_ps(_cellWidth)));
+            __m128 distanceSquared = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_set1_ps(dy2));
+            __m128 distance = _mm_sqrt_ps(distanceSquared);
+
+            __m128 falloff = linear;
+
+            if (light.bleed != 0)
+            {
+                falloff = _mm_add_ps(falloff, _mm_div_ps(bleed, distanceSquared));
+            }
+
+            __m128 attenuation = _mm_mul_ps(_mm_sub_ps(radius, distance), falloff);
+            attenuation = _mm_min_ps(_mm_max_ps(attenuation, zero), one);
+            attenuation = _mm_mul_ps(attenuation, cover);
+
+            float* targets[4] = { red, green, blue, alpha };
+            float channels[4] = { light.color.r, light.color.g, light.color.b, light.color.a };
+
+            for (int channel = 0; channel < 4; ++channel)
+            {
+                float* target = targets[channel] + row + x;
+                _mm_storeu_ps(target, _mm_add_ps(_mm_loadu_ps(target),
+                                                 _mm_mul_ps(attenuation, _mm_set1_ps(channels[channel]))));
+            }
+        }
+#endif
+
+        for (; x < tile.width; ++x)
+        {
+            float cover = coverage[row + x];
+
+            if (cover <= 0)
+            {
+                continue;
+            }
+
+            float dx = x0 + x * _cellWidth;
+            float distanceSquared = dx * dx + dy2;
+            float falloff = linearFalloff;
+
+            if (light.bleed != 0)
+            {
+                falloff += light.bleed / distanceSquared;
+            }
+
+            float attenuation = (light.radius - std::sqrt(distanceSquared)) * falloff;
+            attenuation = std::min(std::max(attenuation, 0.0f), 1.0f) * cover;
+
+            red[row + x] += light.color.r * attenuation;
+            green[row + x] += light.color.g * attenuation;
+            blue[row + x] += light.color.b * attenuation;
+            alpha[row + x] += light.color.a * attenuation;
+        }
+    }
+}
+
+
+} // namespace ofx
@@ -0,0 +1,136 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include "Light2D.h"
+#include "WorkerPool.h"
+#include "ofPixels.h"
+#include "ofRectangle.h"
+
+
+namespace ofx {
+
+
+// A CPU reference implementation of the lighting composite.
+//
+// Each light's fan is rasterized into a coverage buffer, its shadow masks
+// multiply the coverage, and the attenuated light is added to a tiled
+// RGBA float buffer.  Tiles are rendered in parallel and each span is
+// shaded four pixels at a time when SSE2 is available.
+class SoftwareRenderer2D
+{
+public:
+    SoftwareRenderer2D();
+    virtual ~SoftwareRenderer2D();
+
+    void setTileSize(int tileSize);
+    int getTileSize() const;
+
+    void clear();
+
+    // Queue a light and its shadow triangles (indexed, in world
+    // coordinates, may be null).  The mesh must outlive render().
+    void add(const Light2D& light, const ofMesh* shadows);
+
+    // Queue a light whose lit region is given as indexed triangles in world
+    // coordinates, such as a visibility polygon, instead of its fan.
+    void addRegion(const Light2D& light, const ofMesh& region);
+
+    // Render the queued lights at the center of every pixel of a grid
+    // spanning the region.  The pixels must be allocated; their size sets
+    // the resolution.
+    void render(const ofRectangle& region,
+                ofFloatPixels& pixels,
+                WorkerPool& workers);
+
+    static const int DEFAULT_TILE_SIZE;
+
+protected:
+    struct Light
+    {
+        ofVec2f position;
+        ofFloatColor color;
+        float radius;
+        float bleed;
+        float linearizeFactor;
+        ofRectangle bounds;
+        std::size_t firstTriangle;
+        std::size_t numTriangles;
+        const ofMesh* shadows;
+    };
+
+    struct Tile
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    // A light with no triangles or shadows yet.
+    Light makeLight(const Light2D& light) const;
+
+    void renderTile(std::size_t index);
+
+    // With texture coordinates for a, b and c, the value is instead the
+    // penumbra of the interpolated coordinate, see Light2D::getPenumbra().
+    void rasterize(const Tile& tile,
+                   const ofVec2f& a,
+                   const ofVec2f& b,
+                   const ofVec2f& c,
+                   float value,
+                   bool multiply,
+                   float* coverage,
+                   const ofVec2f* texCoords = 0) const;
+
+    void shade(const Tile& tile,
+               const Light& light,
+               const float* coverage,
+               float* accumulator) const;
+
+    int _tileSize;
+
+    std::vector<Light> _lights;
+
+    // World space triangles of every queued light's fan, three vertices each.
+    std::vector<ofVec2f> _fans;
+
+    ofRectangle _region;
+    float _cellWidth;
+    float _cellHeight;
+    int _numTilesX;
+
+    std::vector<Tile> _tiles;
+
+    // Four float planes (r, g, b, a) of tileSize * tileSize per tile.
+    std::vector<float> _buffer;
+
+};
+
+
+} // namespace ofx
@@ -0,0 +1,646 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "TiledLights2D.h"
+#include "ofAppRunner.h"
+#include "ofGraphics.h"
+#include "ofMath.h"
+
+
+#define STRINGIFY(x) #x
+
+
+namespace ofx {
+
+
+const std::size_t TiledLights2D::TILE_SIZE = 32;
+const std::size_t TiledLights2D::SHADOW_MAP_SIZE = 512;
+
+
+const std::string TiledLights2D::DEFAULT_VERTEX_SHADER_SRC = "#version 150\n" STRINGIFY(
+
+uniform mat4 modelViewProjectionMatrix;
+
+in vec4 position;
+
+out vec2 point;
+
+void main()
+{
+    point = position.xy;
+    gl_Position = modelViewProjectionMatrix * position;
+}
+
+);
+
+
+const std::string TiledLights2D::DEFAULT_FRAGMENT_SHADER_SRC = "#version 150\n" STRINGIFY(
+
+uniform sampler2D lights;
+uniform sampler2D tiles;
+uniform sampler2D indices;
+uniform sampler2D shadowMaps;
+
+uniform ivec2 numTiles;
+uniform float tileSize;
+uniform float shadowMapSize;
+uniform int lightTexels;
+uniform int lightsPerRow;
+uniform int indicesPerRow;
+
+in vec2 point;
+
+out vec4 fragColor;
+
+const float TWO_PI = 6.28318530718;
+
+// Lets the light reach an occluder's own edge.
+const float SHADOW_BIAS = 0.5;
+
+vec4 getLight(int light, int texel)
+{
+    return texelFetch(lights, ivec2((light % lightsPerRow) * lightTexels + texel, light / lightsPerRow), 0);
+}
+
+// The fraction of the light that reaches the distance in the direction,
+// filtered between the two nearest directions of the map.
+float getVisibility(int row, float angle, float dist)
+{
+    float x = angle / TWO_PI * shadowMapSize - 0.5;
+    float x0 = floor(x);
+
+    float occluder0 = texelFetch(shadowMaps, ivec2(int(mod(x0, shadowMapSize)), row), 0).r;
+    float occluder1 = texelFetch(shadowMaps, ivec2(int(mod(x0 + 1.0, shadowMapSize)), row), 0).r;
+
+    return mix(step(dist, occluder0 + SHADOW_BIAS),
+               step(dist, occluder1 + SHADOW_BIAS),
+               x - x0);
+}
+
+void main()
+{
+    ivec2 tile = clamp(ivec2(point / tileSize), ivec2(0), numTiles - 1);
+    vec2 range = texelFetch(tiles, tile, 0).xy;
+
+    int first = int(range.x);
+    int last = first + int(range.y);
+
+    vec4 color = vec4(0.0);
+
+    for (int i = first; i < last; ++i)
+    {
+        int light = int(texelFetch(indices, ivec2(i % indicesPerRow, i / indicesPerRow), 0).r);
+
+        vec4 position = getLight(light, 0);
+        vec2 offset = point - position.xy;
+
+        float radius = position.z;
+        float dist = length(offset);
+
+        if (dist >= radius)
+        {
+            continue;
+        }
+
+        vec4 parameters = getLight(light, 2);
+        float angle = atan(offset.y, offset.x);
+
+        // Outside a spot light's wedge.
+        if (parameters.y < TWO_PI && mod(angle - parameters.x, TWO_PI) > parameters.y)
+        {
+            continue;
+        }
+
+        // The same falloff as Light2D::getAttenuation().
+        float falloff = parameters.w / radius;
+
+        if (parameters.z != 0.0)
+        {
+            falloff += parameters.z / (dist * dist);
+        }
+
+        float attenuation = clamp((radius - dist) * falloff, 0.0, 1.0);
+
+        if (position.w >= 0.0)
+        {
+            attenuation *= getVisibility(int(position.w), angle, dist);
+        }
+
+        color += getLight(light, 1) * attenuation;
+    }
+
+    fragColor = color;
+}
+
+);
+
+
+const std::string TiledLights2D::SHADOW_MAP_FRAGMENT_SHADER_SRC = "#version 150\n" STRINGIFY(
+
+uniform sampler2D lights;
+uniform sampler2D shadowMapLights;
+uniform sampler2D shadowMaps;
+uniform sampler2D occluders;
+
+uniform int numShadowMaps;
+uniform float shadowMapSize;
+uniform int lightTexels;
+uniform int lightsPerRow;
+uniform int indicesPerRow;
+
+out vec4 fragColor;
+
+const float TWO_PI = 6.28318530718;
+
+vec4 getLight(int light, int texel)
+{
+    return texelFetch(lights, ivec2((light % lightsPerRow) * lightTexels + texel, light / lightsPerRow), 0);
+}
+
+void main()
+{
+    // The framebuffer's rows are the atlas rows, however it is projected.
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+
+    if (texel.y >= numShadowMaps)
+    {
+        fragColor = vec4(0.0);
+        return;
+    }
+
+    int light = int(texelFetch(shadowMapLights, ivec2(texel.y % indicesPerRow, texel.y / indicesPerRow), 0).r);
+
+    // Maps from the CPU are copied.
+    if (light < 0)
+    {
+        fragColor = texelFetch(shadowMaps, texel, 0);
+        return;
+    }
+
+    vec4 position = getLight(light, 0);
+
+    float angle = (float(texel.x) + 0.5) / shadowMapSize * TWO_PI;
+    vec2 direction = vec2(cos(angle), sin(angle));
+
+    ivec2 size = textureSize(occluders, 0);
+
+    // Past the far corner of the target nothing is known to occlude.
+    float reach = min(position.z, length(vec2(size)) + length(position.xy));
+    float dist = position.z;
+
+    bool isInside = true;
+
+    for (float t = 0.0; t < reach; t += 1.0)
+    {
+        ivec2 pixel = ivec2(floor(position.xy + direction * t));
+
+        bool isCovered = all(greaterThanEqual(pixel, ivec2(0))) &&
+                         all(lessThan(pixel, size)) &&
+                         texelFetch(occluders, pixel, 0).r > 0.5;
+
+        if (isCovered && !isInside)
+        {
+            dist = t;
+            break;
+        }
+
+        isInside = isInside && isCovered;
+    }
+
+    fragColor = vec4(dist);
+}
+
+);
+
+
+TiledLights2D::TiledLights2D():
+    _numShadowMaps(0),
+    _numOccluded(0),
+    _numTilesX(0),
+    _numTilesY(0),
+    _isShadowMapFboCurrent(false),
+    _numLightRows(0),
+    _numIndexRows(0),
+    _numShadowMapRows(0),
+    _numShadowMapLightRows(0),
+    _isSetup(false)
+{
+}
+
+
+TiledLights2D::~TiledLights2D()
+{
+}
+
+
+void TiledLights2D::clear()
+{
+    _lights.clear();
+    _bounds.clear();
+    _shadowMaps.clear();
+    _numShadowMaps = 0;
+    _shadowMapLights.clear();
+    _numOccluded = 0;
+}
+
+
+void TiledLights2D::add(const Light2D& light, const float* shadowMap)
+{
+    const ofVec3f& position = light.getPosition();
+    ofFloatColor color = light.getColor();
+
+    _lights.push_back(position.x);
+    _lights.push_back(position.y);
+    _lights.push_back(light.getRadius());
+    _lights.push_back(shadowMap ? float(_numShadowMaps) : -1.0f);
+
+    _lights.push_back(color.r);
+    _lights.push_back(color.g);
+    _lights.push_back(color.b);
+    _lights.push_back(color.a);
+
+    _lights.push_back(light.getAngle() - light.getViewAngle() / 2.0);
+    _lights.push_back(light.getViewAngle());
+    _lights.push_back(light.getBleed());
+    _lights.push_back(light.getLinearizeFactor());
+
+    _bounds.push_back(light.getBoundingBox());
+
+    if (shadowMap)
+    {
+        _shadowMaps.insert(_shadowMaps.end(), shadowMap, shadowMap + SHADOW_MAP_SIZE);
+        _shadowMapLights.push_back(-1);
+        ++_numShadowMaps;
+    }
+}
+
+
+void TiledLights2D::addOccluded(const Light2D& light)
+{
+    add(light, 0);
+
+    // The light's shadow map row.
+    _lights[_lights.size() - LIGHT_TEXELS * 4 + 3] = _numShadowMaps;
+
+    // A row of the uploaded atlas is kept so that the rows line up.
+    _shadowMaps.resize(_shadowMaps.size() + SHADOW_MAP_SIZE, 0);
+    _shadowMapLights.push_back(size() - 1);
+    ++_numShadowMaps;
+    ++_numOccluded;
+}
+
+
+std::size_t TiledLights2D::size() const
+{
+    return _bounds.size();
+}
+
+
+bool TiledLights2D::empty() const
+{
+    return _bounds.empty();
+}
+
+
+void TiledLights2D::update(float width, float height)
+{
+    if (empty() || width <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    std::size_t numTilesX = std::ceil(width / TILE_SIZE);
+    std::size_t numTilesY = std::ceil(height / TILE_SIZE);
+
+    _tileCounts.assign(numTilesX * numTilesY, 0);
+
+    // Count the lights of every tile, then place each light's index in the
+    // ranges that the counts give.
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (std::size_t i = 0; i < _bounds.size(); ++i)
+        {
+            const ofRectangle& bounds = _bounds[i];
+
+            if (bounds.getMaxX() < 0 ||
+                bounds.getMaxY() < 0 ||
+                bounds.getMinX() >= width ||
+                bounds.getMinY() >= height)
+            {
+                continue;
+            }
+
+            std::size_t minX = std::max(bounds.getMinX(), 0.0f) / TILE_SIZE;
+            std::size_t minY = std::max(bounds.getMinY(), 0.0f) / TILE_SIZE;
+            std::size_t maxX = std::min<std::size_t>(bounds.getMaxX() / TILE_SIZE, numTilesX - 1);
+            std::size_t maxY = std::min<std::size_t>(bounds.getMaxY() / TILE_SIZE, numTilesY - 1);
+
+            for (std::size_t y = minY; y <= maxY; ++y)
+            {
+                for (std::size_t x = minX; x <= maxX; ++x)
+                {
+                    std::size_t tile = y * numTilesX + x;
+
+                    if (pass == 1)
+                    {
+                        _indices[std::size_t(_tiles[tile * 2]) + _tileCounts[tile]] = i;
+                    }
+
+                    ++_tileCounts[tile];
+                }
+            }
+        }
+
+        if (pass == 0)
+        {
+            _tiles.resize(_tileCounts.size() * 2);
+
+            std::size_t numIndices = 0;
+
+            for (std::size_t tile = 0; tile < _tileCounts.size(); ++tile)
+            {
+                _tiles[tile * 2] = numIndices;
+                _tiles[tile * 2 + 1] = _tileCounts[tile];
+                numIndices += _tileCounts[tile];
+                _tileCounts[tile] = 0;
+            }
+
+            std::size_t numIndexRows = std::max<std::size_t>((numIndices + INDICES_PER_ROW - 1) / INDICES_PER_ROW, 1);
+
+            _indices.assign(numIndexRows * INDICES_PER_ROW, 0);
+        }
+    }
+
+    if (!_isSetup)
+    {
+        setup();
+    }
+
+    std::size_t numLightRows = (size() + LIGHTS_PER_ROW - 1) / LIGHTS_PER_ROW;
+    std::size_t numIndexRows = _indices.size() / INDICES_PER_ROW;
+    std::size_t numShadowMapRows = std::max<std::size_t>(_numShadowMaps, 1);
+
+    std::size_t numShadowMapLightRows = (numShadowMapRows + INDICES_PER_ROW - 1) / INDICES_PER_ROW;
+
+    // Whole rows are uploaded.
+    _lights.resize(numLightRows * LIGHTS_PER_ROW * LIGHT_TEXELS * 4, 0);
+    _shadowMaps.resize(numShadowMapRows * SHADOW_MAP_SIZE, 0);
+    _shadowMapLights.resize(numShadowMapLightRows * INDICES_PER_ROW, -1);
+
+    _isShadowMapFboCurrent = false;
+
+    if (numTilesX != _numTilesX || numTilesY != _numTilesY)
+    {
+        _tileTexture.allocate(numTilesX, numTilesY, GL_RG32F, false, GL_RG, GL_FLOAT);
+        _numTilesX = numTilesX;
+        _numTilesY = numTilesY;
+    }
+
+    reserve(_lightTexture, _numLightRows, LIGHTS_PER_ROW * LIGHT_TEXELS, numLightRows, GL_RGBA32F);
+    reserve(_indexTexture, _numIndexRows, INDICES_PER_ROW, numIndexRows, GL_R32F);
+    reserve(_shadowMapTexture, _numShadowMapRows, SHADOW_MAP_SIZE, numShadowMapRows, GL_R32F);
+
+    _lightTexture.loadData(&_lights[0], LIGHTS_PER_ROW * LIGHT_TEXELS, numLightRows, GL_RGBA);
+    _tileTexture.loadData(&_tiles[0], numTilesX, numTilesY, GL_RG);
+    _indexTexture.loadData(&_indices[0], INDICES_PER_ROW, numIndexRows, GL_RED);
+
+    // Maps found on the GPU need nothing uploaded but their lights.
+    if (_numOccluded < _numShadowMaps)
+    {
+        _shadowMapTexture.loadData(&_shadowMaps[0], SHADOW_MAP_SIZE, numShadowMapRows, GL_RED);
+    }
+
+    if (_numOccluded > 0)
+    {
+        reserve(_shadowMapLightTexture, _numShadowMapLightRows, INDICES_PER_ROW, numShadowMapLightRows, GL_R32F);
+
+        _shadowMapLightTexture.loadData(&_shadowMapLights[0], INDICES_PER_ROW, numShadowMapLightRows, GL_RED);
+    }
+}
+
+
+void TiledLights2D::updateShadowMaps(const ofTexture& occluders)
+{
+    if (_numOccluded == 0 || !_isSetup)
+    {
+        return;
+    }
+
+    if (_shadowMapFbo.getHeight() < _numShadowMapRows)
+    {
+        ofFbo::Settings settings;
+        settings.width = SHADOW_MAP_SIZE;
+        settings.height = _numShadowMapRows;
+        settings.internalformat = GL_R32F;
+        settings.textureTarget = GL_TEXTURE_2D;
+
+        _shadowMapFbo.allocate(settings);
+    }
+
+    _shadowMapFbo.begin();
+
+    ofPushStyle();
+    ofEnableBlendMode(OF_BLENDMODE_DISABLED);
+    ofFill();
+
+    _shadowMapShader.begin();
+    _shadowMapShader.setUniformTexture("lights", _lightTexture, 1);
+    _shadowMapShader.setUniformTexture("shadowMapLights", _shadowMapLightTexture, 2);
+    _shadowMapShader.setUniformTexture("shadowMaps", _shadowMapTexture, 3);
+    _shadowMapShader.setUniformTexture("occluders", occluders, 4);
+    _shadowMapShader.setUniform1i("numShadowMaps", _numShadowMaps);
+    _shadowMapShader.setUniform1f("shadowMapSize", SHADOW_MAP_SIZE);
+    _shadowMapShader.setUniform1i("lightTexels", LIGHT_TEXELS);
+    _shadowMapShader.setUniform1i("lightsPerRow", LIGHTS_PER_ROW);
+    _shadowMapShader.setUniform1i("indicesPerRow", INDICES_PER_ROW);
+
+    // Every texel of the atlas, whichever way up it is projected.
+    ofDrawRectangle(0, 0, _shadowMapFbo.getWidth(), _shadowMapFbo.getHeight());
+
+    _shadowMapShader.end();
+
+    ofPopStyle();
+
+    _shadowMapFbo.end();
+
+    _isShadowMapFboCurrent = true;
+}
+
+
+void TiledLights2D::draw(const ofRectangle& region)
+{
+    if (empty() || !_isSetup)
+    {
+        return;
+    }
+
+    _shader.begin();
+    _shader.setUniformTexture("lights", _lightTexture, 1);
+    _shader.setUniformTexture("tiles", _tileTexture, 2);
+    _shader.setUniformTexture("indices", _indexTexture, 3);
+    _shader.setUniformTexture("shadowMaps",
+                              _isShadowMapFboCurrent ? _shadowMapFbo.getTexture() : _shadowMapTexture,
+                              4);
+    _shader.setUniform2i("numTiles", _numTilesX, _numTilesY);
+    _shader.setUniform1f("tileSize", TILE_SIZE);
+    _shader.setUniform1f("shadowMapSize", SHADOW_MAP_SIZE);
+    _shader.setUniform1i("lightTexels", LIGHT_TEXELS);
+    _shader.setUniform1i("lightsPerRow", LIGHTS_PER_ROW);
+    _shader.setUniform1i("indicesPerRow", INDICES_PER_ROW);
+
+    ofPushStyle();
+    ofFill();
+    ofDrawRectangle(region);
+    ofPopStyle();
+
+    _shader.end();
+}
+
+
+bool TiledLights2D::isSupported()
+{
+    return ofIsGLProgrammableRenderer();
+}
+
+
+void TiledLights2D::makeShadowMap(const ofMesh& polygon, std::vector<float>& shadowMap)
+{
+    const std::vector<ofVec3f>& vertices = polygon.getVertices();
+
+    if (polygon.getIndices().empty() || vertices.size() < 3)
+    {
+        shadowMap.clear();
+        return;
+    }
+
+    // Directions outside the polygon, i.e. outside a spot light's wedge,
+    // are dark.
+    shadowMap.assign(SHADOW_MAP_SIZE, 0);
+
+    const float step = TWO_PI / SHADOW_MAP_SIZE;
+
+    // The polygon is a fan from the light through its boundary points, in
+    // order of increasing angle.  Each direction is sampled at its middle
+    // against the boundary edge it crosses.
+    ofVec2f center(vertices[0].x, vertices[0].y);
+    ofVec2f a(vertices[1].x - center.x, vertices[1].y - center.y);
+
+    float angleA = atan2(a.y, a.x);
+
+    const int n = SHADOW_MAP_SIZE;
+
+    int firstTexel = 0;
+    int lastTexel = -1;
+
+    for (std::size_t i = 2; i < vertices.size(); ++i)
+    {
+        ofVec2f b(vertices[i].x - center.x, vertices[i].y - center.y);
+        ofVec2f edge = b - a;
+
+        // The angle from a to b, never back.
+        float turn = atan2(a.x * b.y - a.y * b.x, a.dot(b));
+        float angleB = angleA + std::max(turn, 0.0f);
+
+        for (int j = std::ceil(angleA / step - 0.5f); (j + 0.5f) * step < angleB; ++j)
+        {
+            float angle = (j + 0.5f) * step;
+
+            ofVec2f direction(cos(angle), sin(angle));
+
+            float denominator = direction.x * edge.y - direction.y * edge.x;
+            float distance = 0;
+
+            // An edge along the direction is only touched at its near end.
+            if (std::abs(denominator) <= 1e-6f * edge.length())
+            {
+                distance = std::min(a.length(), b.length());
+            }
+            else
+            {
+                distance = (a.x * edge.y - a.y * edge.x) / denominator;
+            }
+
+            shadowMap[((j % n) + n) % n] = std::max(distance, 0.0f);
+
+            if (lastTexel < firstTexel)
+            {
+                firstTexel = j;
+            }
+
+            lastTexel = j;
+        }
+
+        a = b;
+        angleA = angleB;
+    }
+
+    // The shader cuts a spot light's wedge itself, so the directions just
+    // outside it repeat those at its edges, and filtering between them does
+    // not darken the edges.
+    if (lastTexel >= firstTexel && lastTexel - firstTexel + 1 < n)
+    {
+        shadowMap[((firstTexel - 1) % n + n) % n] = shadowMap[((firstTexel % n) + n) % n];
+        shadowMap[((lastTexel + 1) % n + n) % n] = shadowMap[((lastTexel % n) + n) % n];
+    }
+}
+
+
+void TiledLights2D::setup()
+{
+    _shader.setupShaderFromSource(GL_VERTEX_SHADER, DEFAULT_VERTEX_SHADER_SRC);
+    _shader.setupShaderFromSource(GL_FRAGMENT_SHADER, DEFAULT_FRAGMENT_SHADER_SRC);
+    _shader.bindDefaults();
+    _shader.linkProgram();
+
+    _shadowMapShader.setupShaderFromSource(GL_VERTEX_SHADER, DEFAULT_VERTEX_SHADER_SRC);
+    _shadowMapShader.setupShaderFromSource(GL_FRAGMENT_SHADER, SHADOW_MAP_FRAGMENT_SHADER_SRC);
+    _shadowMapShader.bindDefaults();
+    _shadowMapShader.linkProgram();
+
+    _isSetup = true;
+}
+
+
+void TiledLights2D::reserve(ofTexture& texture,
+                            std::size_t& numRows,
+                            std::size_t width,
+                            std::size_t minRows,
+                            int internalFormat)
+{
+    if (minRows <= numRows)
+    {
+        return;
+    }
+
+    numRows = std::max(minRows, numRows * 2);
+
+    int format = internalFormat == GL_RGBA32F ? GL_RGBA : GL_RED;
+
+    texture.allocate(width, numRows, internalFormat, false, format, GL_FLOAT);
+}
+
+
+} // namespace ofx
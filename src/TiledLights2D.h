@@ -0,0 +1,161 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include <vector>
+#include "Light2D.h"
+#include "ofMesh.h"
+#include "ofRectangle.h"
+#include "ofFbo.h"
+#include "ofShader.h"
+#include "ofTexture.h"
+
+
+namespace ofx {
+
+
+// Evaluates many lights, with their shadows, in one pass over the target.
+//
+// The target is divided into tiles of TILE_SIZE pixels, and every light is
+// binned on the CPU into the tiles its bounding box covers.  The lights'
+// parameters, the light list of every tile and the lights' shadow maps are
+// uploaded as float textures, and each fragment loops over the lights of
+// its own tile only.  The cost then follows the number of lights per pixel
+// rather than one full pass per light.  Needs the programmable renderer.
+//
+// A light's shadows are a polar shadow map: the distance to the nearest
+// occluder in each of SHADOW_MAP_SIZE directions around it.  The maps of
+// all lights are the rows of one atlas, either uploaded from the CPU or
+// found on the GPU by marching outward through a texture of the occluders.
+class TiledLights2D
+{
+public:
+    TiledLights2D();
+    virtual ~TiledLights2D();
+
+    void clear();
+
+    // Add a light, and its shadow map of SHADOW_MAP_SIZE distances, or null
+    // if nothing occludes it.
+    void add(const Light2D& light, const float* shadowMap);
+
+    // Add a light whose shadow map updateShadowMaps() finds on the GPU.
+    void addOccluded(const Light2D& light);
+
+    std::size_t size() const;
+    bool empty() const;
+
+    // Bin the lights into the tiles of a target of the size and upload
+    // them.  Call once after the lights are added, before draw().
+    void update(float width, float height);
+
+    // Find the shadow maps of the lights added with addOccluded(), all in
+    // one pass over the atlas.  Each texel steps one pixel at a time from
+    // its light along its direction, up to the light's radius, until it
+    // meets a covered pixel of the occluders, a GL_TEXTURE_2D of the
+    // target's size.  Occluders around the light itself are stepped out of
+    // first.  Call after update().
+    void updateShadowMaps(const ofTexture& occluders);
+
+    // Add every light to the region of the target.
+    void draw(const ofRectangle& region);
+
+    static bool isSupported();
+
+    // Sample a light's visibility polygon, a fan around the light's
+    // position, into a shadow map.  An empty polygon gives an empty map.
+    static void makeShadowMap(const ofMesh& polygon, std::vector<float>& shadowMap);
+
+    static const std::size_t TILE_SIZE;
+    static const std::size_t SHADOW_MAP_SIZE;
+    static const std::string DEFAULT_VERTEX_SHADER_SRC;
+    static const std::string DEFAULT_FRAGMENT_SHADER_SRC;
+    static const std::string SHADOW_MAP_FRAGMENT_SHADER_SRC;
+
+protected:
+    enum
+    {
+        // Texels per light, and lights and indices per texture row.
+        LIGHT_TEXELS = 3,
+        LIGHTS_PER_ROW = 256,
+        INDICES_PER_ROW = 1024
+    };
+
+    void setup();
+
+    // Grow the texture to hold at least the rows, keeping its width.
+    static void reserve(ofTexture& texture,
+                        std::size_t& numRows,
+                        std::size_t width,
+                        std::size_t minRows,
+                        int internalFormat);
+
+    // x, y, radius, shadow map row or -1; color; start angle, view angle,
+    // bleed, linearize factor.
+    std::vector<float> _lights;
+    std::vector<ofRectangle> _bounds;
+    std::vector<float> _shadowMaps;
+    std::size_t _numShadowMaps;
+
+    // The light of every shadow map row, or -1 for an uploaded map.
+    std::vector<float> _shadowMapLights;
+    std::size_t _numOccluded;
+
+    // The first index and the number of lights of each tile, and the
+    // lights of all tiles, tile by tile.
+    std::vector<float> _tiles;
+    std::vector<float> _indices;
+    std::vector<uint32_t> _tileCounts;
+    std::size_t _numTilesX;
+    std::size_t _numTilesY;
+
+    ofTexture _lightTexture;
+    ofTexture _tileTexture;
+    ofTexture _indexTexture;
+    ofTexture _shadowMapTexture;
+    ofTexture _shadowMapLightTexture;
+
+    // The atlas with the maps found on the GPU, used instead of the
+    // uploaded one once updateShadowMaps() has run for the lights.
+    ofFbo _shadowMapFbo;
+    bool _isShadowMapFboCurrent;
+
+    std::size_t _numLightRows;
+    std::size_t _numIndexRows;
+    std::size_t _numShadowMapRows;
+    std::size_t _numShadowMapLightRows;
+
+    bool _isSetup;
+
+    ofShader _shader;
+    ofShader _shadowMapShader;
+
+};
+
+
+} // namespace ofx
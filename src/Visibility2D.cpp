@@ -0,0 +1,488 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "Visibility2D.h"
+#include <algorithm>
+#include "ofMath.h"
+
+
+namespace ofx {
+
+
+Visibility2D::Visibility2D():
+    _numOccluders(0),
+    _startAngle(0)
+{
+}
+
+
+Visibility2D::~Visibility2D()
+{
+}
+
+
+void Visibility2D::clear()
+{
+    _segments.clear();
+    _numOccluders = 0;
+}
+
+
+void Visibility2D::addSegment(const ofVec2f& a, const ofVec2f& b)
+{
+    // Drop any boundary left by the last compute().
+    _segments.resize(_numOccluders);
+
+    Segment segment;
+    segment.a = a;
+    segment.b = b;
+
+    _segments.push_back(segment);
+
+    _numOccluders = _segments.size();
+}
+
+
+std::size_t Visibility2D::getNumSegments() const
+{
+    return _numOccluders;
+}
+
+
+void Visibility2D::compute(const ofVec2f& position,
+                           float radius,
+                           float startAngle,
+                           float viewAngle,
+                           ofMesh& polygon)
+{
+    _position = position;
+    _startAngle = startAngle;
+
+    viewAngle = std::min(viewAngle, (float)TWO_PI);
+
+    _segments.resize(_numOccluders);
+
+    // Occluders are clipped to the light's circle, so that they never cross
+    // the boundary polygon around it.
+    for (std::size_t i = 0; i < _numOccluders; ++i)
+    {
+        Segment& segment = _segments[i];
+
+        ofVec2f edge = segment.b - segment.a;
+        ofVec2f offset = segment.a - _position;
+
+        float a = edge.dot(edge);
+        float b = 2 * offset.dot(edge);
+        float c = offset.dot(offset) - radius * radius;
+        float discriminant = b * b - 4 * a * c;
+
+        if (a <= 0 || discriminant <= 0)
+        {
+            // Marked as edge-on, so that it is skipped below.
+            segment.b = segment.a;
+            continue;
+        }
+
+        float root = sqrt(discriminant);
+        float first = std::max((-b - root) / (2 * a), 0.0f);
+        float last = std::min((-b + root) / (2 * a), 1.0f);
+
+        if (first >= last)
+        {
+            segment.b = segment.a;
+            continue;
+        }
+
+        segment.b = segment.a + edge * last;
+        segment.a = segment.a + edge * first;
+    }
+
+    splitCrossings();
+
+    // A polygon around the circle, as fine as the light's fan.  Its
+    // vertices are offset by half a side from the start angle, so that none
+    // lies on the first sweep ray.
+    std::size_t numBoundarySegments = std::max(Light2D::getNumSegments(radius, TWO_PI),
+                                               std::size_t(3));
+
+    float step = TWO_PI / numBoundarySegments;
+    float boundaryRadius = radius / cos(step / 2);
+
+    for (std::size_t i = 0; i < numBoundarySegments; ++i)
+    {
+        float angle = startAngle + (i + 0.5f) * step;
+
+        Segment segment;
+        segment.a = _position + ofVec2f(cos(angle), sin(angle)) * boundaryRadius;
+        segment.b = _position + ofVec2f(cos(angle + step), sin(angle + step)) * boundaryRadius;
+
+        _segments.push_back(segment);
+    }
+
+    _events.clear();
+    _initial.clear();
+
+    for (std::size_t i = 0; i < _segments.size(); ++i)
+    {
+        Segment& segment = _segments[i];
+
+        ofVec2f a = segment.a - _position;
+        ofVec2f b = segment.b - _position;
+
+        float cross = a.x * b.y - a.y * b.x;
+
+        // Edge-on segments hide nothing.
+        if (std::abs(cross) <= 1e-6f * a.length() * b.length())
+        {
+            continue;
+        }
+
+        // Orient every segment counterclockwise around the light.
+        if (cross < 0)
+        {
+            std::swap(segment.a, segment.b);
+        }
+
+        Event begin = { getAngle(segment.a), (uint32_t)i, true };
+        Event end = { getAngle(segment.b), (uint32_t)i, false };
+
+        // A segment that crosses the start of the sweep is active from the
+        // start until its end, and again from its begin.
+        if (begin.angle > end.angle)
+        {
+            _initial.push_back(i);
+        }
+
+        _events.push_back(begin);
+        _events.push_back(end);
+    }
+
+    std::sort(_events.begin(), _events.end());
+
+    _active.clear();
+
+    _direction.set(cos(startAngle), sin(startAngle));
+
+    for (std::size_t i = 0; i < _initial.size(); ++i)
+    {
+        activate(_initial[i]);
+    }
+
+    polygon.setMode(OF_PRIMITIVE_TRIANGLES);
+
+    ofIndexType center = polygon.getNumVertices();
+
+    polygon.addVertex(_position);
+
+    if (!_active.empty())
+    {
+        addPoint(_active.front(), polygon);
+    }
+
+    const uint32_t none = (uint32_t)-1;
+
+    std::size_t i = 0;
+
+    while (i < _events.size() && _events[i].angle <= viewAngle)
+    {
+        float angle = _events[i].angle;
+
+        _direction.set(cos(startAngle + angle), sin(startAngle + angle));
+
+        uint32_t before = _active.empty() ? none : _active.front();
+
+        // Events at the same angle change the closest segment only once.
+        while (i < _events.size() &&
+               _events[i].angle - angle <= 1e-6f &&
+               _events[i].angle <= viewAngle)
+        {
+            const Event& event = _events[i];
+
+            if (event.isBegin)
+            {
+                activate(event.segment);
+            }
+            else
+            {
+                deactivate(event.segment);
+            }
+
+            ++i;
+        }
+
+        uint32_t after = _active.empty() ? none : _active.front();
+
+        if (after != before)
+        {
+            if (before != none)
+            {
+                addPoint(before, polygon);
+            }
+
+            if (after != none)
+            {
+                addPoint(after, polygon);
+            }
+        }
+    }
+
+    _direction.set(cos(startAngle + viewAngle), sin(startAngle + viewAngle));
+
+    if (!_active.empty())
+    {
+        addPoint(_active.front(), polygon);
+    }
+
+    for (ofIndexType index = center + 1; index + 1 < polygon.getNumVertices(); ++index)
+    {
+        polygon.addIndex(center);
+        polygon.addIndex(index);
+        polygon.addIndex(index + 1);
+    }
+}
+
+
+void Visibility2D::splitCrossings()
+{
+    // Occluders that overlap cross each other, and would swap places in the
+    // active list between events.  Splitting them where they cross gives the
+    // sweep an event wherever the closest one may change.
+    _order.clear();
+    _splits.clear();
+
+    for (std::size_t i = 0; i < _segments.size(); ++i)
+    {
+        if (_segments[i].a != _segments[i].b)
+        {
+            _order.push_back(i);
+        }
+    }
+
+    // Only segments whose x ranges overlap are tested against each other.
+    std::sort(_order.begin(), _order.end(), [this](uint32_t a, uint32_t b) {
+        return std::min(_segments[a].a.x, _segments[a].b.x) <
+               std::min(_segments[b].a.x, _segments[b].b.x);
+    });
+
+    for (std::size_t i = 0; i < _order.size(); ++i)
+    {
+        const Segment& first = _segments[_order[i]];
+
+        ofVec2f firstEdge = first.b - first.a;
+
+        float maxX = std::max(first.a.x, first.b.x);
+        float minY = std::min(first.a.y, first.b.y);
+        float maxY = std::max(first.a.y, first.b.y);
+
+        for (std::size_t j = i + 1; j < _order.size(); ++j)
+        {
+            const Segment& second = _segments[_order[j]];
+
+            if (std::min(second.a.x, second.b.x) > maxX)
+            {
+                break;
+            }
+
+            if (std::max(second.a.y, second.b.y) < minY ||
+                std::min(second.a.y, second.b.y) > maxY)
+            {
+                continue;
+            }
+
+            ofVec2f secondEdge = second.b - second.a;
+            ofVec2f offset = second.a - first.a;
+
+            float denominator = firstEdge.x * secondEdge.y - firstEdge.y * secondEdge.x;
+
+            if (denominator == 0)
+            {
+                continue;
+            }
+
+            float s = (offset.x * secondEdge.y - offset.y * secondEdge.x) / denominator;
+            float t = (offset.x * firstEdge.y - offset.y * firstEdge.x) / denominator;
+
+            // Segments that only touch at an end never swap places.
+            if (s > 0 && s < 1 && t > 0 && t < 1)
+            {
+                Split split = { _order[i], s };
+                _splits.push_back(split);
+
+                split.segment = _order[j];
+                split.t = t;
+                _splits.push_back(split);
+            }
+        }
+    }
+
+    std::sort(_splits.begin(), _splits.end());
+
+    std::vector<Split>::const_iterator iter = _splits.begin();
+
+    while (iter != _splits.end())
+    {
+        uint32_t index = iter->segment;
+
+        Segment whole = _segments[index];
+        ofVec2f edge = whole.b - whole.a;
+
+        // The segment keeps its first piece, and the rest are appended.
+        ofVec2f point = whole.a + edge * iter->t;
+
+        _segments[index].b = point;
+
+        ++iter;
+
+        while (iter != _splits.end() && iter->segment == index)
+        {
+            Segment piece;
+            piece.a = point;
+            piece.b = point = whole.a + edge * iter->t;
+
+            _segments.push_back(piece);
+
+            ++iter;
+        }
+
+        Segment piece;
+        piece.a = point;
+        piece.b = whole.b;
+
+        _segments.push_back(piece);
+    }
+}
+
+
+void Visibility2D::activate(uint32_t segment)
+{
+    _active.insert(std::upper_bound(_active.begin(), _active.end(), segment, Closer(*this)),
+                   segment);
+}
+
+
+void Visibility2D::deactivate(uint32_t segment)
+{
+    std::vector<uint32_t>::iterator iter = std::find(_active.begin(), _active.end(), segment);
+
+    if (iter != _active.end())
+    {
+        _active.erase(iter);
+    }
+}
+
+
+float Visibility2D::getDistance(const Segment& segment, const ofVec2f& direction) const
+{
+    ofVec2f edge = segment.b - segment.a;
+    ofVec2f offset = segment.a - _position;
+
+    float denominator = direction.x * edge.y - direction.y * edge.x;
+
+    // A segment along the ray is only ever touched at its near end.
+    if (std::abs(denominator) <= 1e-6f * edge.length())
+    {
+        return std::min(offset.length(), (segment.b - _position).length());
+    }
+
+    return (offset.x * edge.y - offset.y * edge.x) / denominator;
+}
+
+
+float Visibility2D::getAngle(const ofVec2f& point) const
+{
+    float angle = atan2(point.y - _position.y, point.x - _position.x) - _startAngle;
+
+    angle -= TWO_PI * std::floor(angle / TWO_PI);
+
+    return angle < TWO_PI ? angle : 0;
+}
+
+
+void Visibility2D::addPoint(uint32_t segment, ofMesh& polygon) const
+{
+    float distance = std::max(getDistance(_segments[segment], _direction), 0.0f);
+
+    ofVec3f point = _position + _direction * distance;
+
+    // Segments that meet at a corner give the same point twice.
+    if (polygon.getVertices().back() != point)
+    {
+        polygon.addVertex(point);
+    }
+}
+
+
+Visibility2D::Closer::Closer(const Visibility2D& visibility_):
+    visibility(&visibility_)
+{
+}
+
+
+bool Visibility2D::Closer::operator () (uint32_t a, uint32_t b) const
+{
+    const Segment& first = visibility->_segments[a];
+    const Segment& second = visibility->_segments[b];
+
+    ofVec2f direction = visibility->_direction;
+
+    float firstDistance = visibility->getDistance(first, direction);
+    float secondDistance = visibility->getDistance(second, direction);
+
+    if (std::abs(firstDistance - secondDistance) > 1e-4f * std::max(firstDistance, secondDistance))
+    {
+        return firstDistance < secondDistance;
+    }
+
+    // The segments meet on the ray, so compare them just past it, halfway
+    // to the nearer of their ends.
+    ofVec2f firstEnd = first.b - visibility->_position;
+    ofVec2f secondEnd = second.b - visibility->_position;
+
+    float firstAngle = atan2(direction.x * firstEnd.y - direction.y * firstEnd.x,
+                             direction.dot(firstEnd));
+    float secondAngle = atan2(direction.x * secondEnd.y - direction.y * secondEnd.x,
+                              direction.dot(secondEnd));
+
+    float angle = std::min(firstAngle, secondAngle) / 2;
+
+    if (angle > 0)
+    {
+        direction.rotateRad(angle);
+
+        firstDistance = visibility->getDistance(first, direction);
+        secondDistance = visibility->getDistance(second, direction);
+
+        if (firstDistance != secondDistance)
+        {
+            return firstDistance < secondDistance;
+        }
+    }
+
+    return a < b;
+}
+
+
+} // namespace ofx
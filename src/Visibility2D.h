@@ -0,0 +1,160 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include <vector>
+#include "Light2D.h"
+#include "ofMesh.h"
+#include "ofVec2f.h"
+
+
+namespace ofx {
+
+
+// The region a light can see, found with an angular sweep over the
+// occluding segments.
+//
+// Segment endpoints are sorted by angle around the light and swept in
+// order, keeping the segments that cross the sweep ray in a list sorted by
+// their distance from the light.  Wherever the closest segment changes,
+// the polygon gains a point on the old and the new one.  A polygon
+// slightly larger than the light's circle closes the region where nothing
+// occludes the light.
+//
+// Overlapping occluders are first split where they cross, so that the
+// order of the list only changes at events.  Every pair of segments whose
+// x ranges overlap is tested, which is O(n^2) at worst, e.g. for a pile of
+// overlapping shapes; sorting the events of n segments with k crossings
+// takes O((n + k) log(n + k)).  The list is a vector, so that the sweep
+// does not allocate once warmed up; each insert or erase moves the
+// entries behind it, which are few unless many segments cross the ray.
+//
+// See https://www.redblobgames.com/articles/visibility/ and
+// http://ncase.me/sight-and-light/.
+class Visibility2D
+{
+public:
+    Visibility2D();
+    virtual ~Visibility2D();
+
+    void clear();
+
+    void addSegment(const ofVec2f& a, const ofVec2f& b);
+
+    std::size_t getNumSegments() const;
+
+    // Append the visible region of a light at the position as a fan of
+    // indexed triangles in world coordinates.  The sweep covers the wedge
+    // from startAngle to startAngle + viewAngle.
+    void compute(const ofVec2f& position,
+                 float radius,
+                 float startAngle,
+                 float viewAngle,
+                 ofMesh& polygon);
+
+protected:
+    struct Segment
+    {
+        ofVec2f a;
+        ofVec2f b;
+    };
+
+    struct Event
+    {
+        float angle;
+        uint32_t segment;
+        bool isBegin;
+
+        // Ends sort before begins at the same angle, so that a segment is
+        // never compared with a neighbour it merely touches.
+        bool operator < (const Event& other) const
+        {
+            return angle < other.angle || (angle == other.angle && !isBegin && other.isBegin);
+        }
+    };
+
+    // A point where a segment crosses another, as a fraction along it.
+    struct Split
+    {
+        uint32_t segment;
+        float t;
+
+        bool operator < (const Split& other) const
+        {
+            return segment < other.segment || (segment == other.segment && t < other.t);
+        }
+    };
+
+    // Orders segments by their distance from the light along the current
+    // sweep ray.  Once split by splitCrossings(), segments at most touch,
+    // so the order stays valid as the ray turns.
+    struct Closer
+    {
+        Closer(const Visibility2D& visibility);
+
+        bool operator () (uint32_t a, uint32_t b) const;
+
+        const Visibility2D* visibility;
+    };
+
+    // Split the clipped occluders wherever two of them cross, appending all
+    // but the first piece of each.
+    void splitCrossings();
+
+    // Insert the segment into the active list, or erase it.
+    void activate(uint32_t segment);
+    void deactivate(uint32_t segment);
+
+    // The distance from the light to the segment along the ray.
+    float getDistance(const Segment& segment, const ofVec2f& direction) const;
+
+    // The angle of the point around the light, relative to the sweep's
+    // start, in [0, TWO_PI).
+    float getAngle(const ofVec2f& point) const;
+
+    void addPoint(uint32_t segment, ofMesh& polygon) const;
+
+    std::vector<Segment> _segments;
+    std::size_t _numOccluders;
+
+    std::vector<uint32_t> _order;
+    std::vector<Split> _splits;
+
+    std::vector<Event> _events;
+    std::vector<uint32_t> _initial;
+
+    // The segments crossing the sweep ray, closest first.
+    std::vector<uint32_t> _active;
+
+    ofVec2f _position;
+    float _startAngle;
+    ofVec2f _direction;
+};
+
+
+} // namespace ofx
@@ -0,0 +1,179 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#include "WorkerPool.h"
+#include <algorithm>
+
+
+namespace ofx {
+
+
+WorkerPool::WorkerPool(std::size_t numThreads):
+    _job(0),
+    _count(0),
+    _next(0),
+    _pending(0),
+    _generation(0),
+    _isStopping(false)
+{
+    start(numThreads);
+}
+
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+
+void WorkerPool::setNumThreads(std::size_t numThreads)
+{
+    stop();
+    start(numThreads);
+}
+
+
+std::size_t WorkerPool::getNumThreads() const
+{
+    return _threads.size() + 1;
+}
+
+
+void WorkerPool::run(std::size_t count, const Job& job)
+{
+    if (_threads.empty() || count < 2)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            job(i);
+        }
+
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _job = &job;
+        _count = count;
+        _next = 0;
+        _pending = _threads.size();
+        ++_generation;
+    }
+
+    _wake.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (_pending > 0)
+    {
+        _done.wait(lock);
+    }
+
+    _job = 0;
+}
+
+
+void WorkerPool::start(std::size_t numThreads)
+{
+    if (numThreads == 0)
+    {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    _isStopping = false;
+
+    for (std::size_t i = 1; i < numThreads; ++i)
+    {
+        _threads.push_back(std::thread(&WorkerPool::threadMain, this, _generation));
+    }
+}
+
+
+void WorkerPool::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _isStopping = true;
+    }
+
+    _wake.notify_all();
+
+    for (std::size_t i = 0; i < _threads.size(); ++i)
+    {
+        _threads[i].join();
+    }
+
+    _threads.clear();
+}
+
+
+void WorkerPool::work()
+{
+    std::size_t index = _next++;
+
+    while (index < _count)
+    {
+        (*_job)(index);
+        index = _next++;
+    }
+}
+
+
+void WorkerPool::threadMain(std::size_t generation)
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            while (!_isStopping && generation == _generation)
+            {
+                _wake.wait(lock);
+            }
+
+            if (_isStopping)
+            {
+                return;
+            }
+
+            generation = _generation;
+        }
+
+        work();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        if (--_pending == 0)
+        {
+            _done.notify_one();
+        }
+    }
+}
+
+
+} // namespace ofx
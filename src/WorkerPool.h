@@ -0,0 +1,83 @@
+// =============================================================================
+//
+// Copyright (c) 2014 Christopher Baker <http://christopherbaker.net>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// =============================================================================
+
+
+
+#pragma once
+
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace ofx {
+
+
+// A small persistent thread pool used to run independent jobs in parallel.
+// Jobs are handed out one index at a time, so faster threads simply take
+// more of them.
+class WorkerPool
+{
+public:
+    typedef std::function<void(std::size_t)> Job;
+
+    // The number of threads includes the calling thread.  Zero selects the
+    // hardware concurrency.
+    WorkerPool(std::size_t numThreads = 0);
+    virtual ~WorkerPool();
+
+    void setNumThreads(std::size_t numThreads);
+    std::size_t getNumThreads() const;
+
+    // Call job(i) for each i in [0, count) and block until all are done.
+    void run(std::size_t count, const Job& job);
+
+protected:
+    void start(std::size_t numThreads);
+    void stop();
+
+    void work();
+    void threadMain(std::size_t generation);
+
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+
+    const Job* _job;
+    std::size_t _count;
+    std::atomic<std::size_t> _next;
+    std::size_t _pending;
+    std::size_t _generation;
+    bool _isStopping;
+
+};
+
+
+} // namespace ofx